@@ -0,0 +1,88 @@
+#ifndef ALL_PAIRS_H
+#define ALL_PAIRS_H
+#include <string>
+#include <vector>
+#include "gst.hpp"
+#include "result_cache.hpp"
+
+/*
+ * Tiles of documents a < b, with the indexes into a first and the indexes into b second.
+ */
+struct PairTiles {
+    const std::size_t a;
+    const std::size_t b;
+    Tiles tiles;
+};
+
+typedef std::vector<PairTiles> AllPairsTiles;
+
+/*
+ * Lower bound on the similarity of the pairs kept by match_all_pairs.
+ * The similarity of a pair is the amount of tiled tokens divided by the mean of the weights of both documents, 0 if both weights are 0.
+ */
+struct SimilarityCutoff {
+    double minimum_similarity;
+    // Weight of every document, the amount of unmarked tokens of every document if empty
+    std::vector<std::size_t> weights;
+};
+
+// Prepared bytes of the documents of one block, so that the two blocks being matched fit in a typical L2 cache
+constexpr std::size_t default_all_pairs_block_size = 128 * 1024;
+
+/*
+ * Match all pairs a < b of (tokens, marks) documents and return their tiles ordered by a and b.
+ * As in matchlib, the shorter document of a pair is the pattern, a if both are equally long.
+ * Every document is prepared once, and the pairs are visited in square blocks of consecutive documents,
+ * so that the tokens and hashes of both blocks stay in cache while all pairs between them are matched.
+ * With HashingMode::rolling, the window fingerprints of all documents at init_search_length are computed in one batch.
+ * A block holds documents of at most block_size prepared bytes, or a single larger document. block_size 0 visits the pairs row by row.
+ * If cache is not null, tiles are read from it when present and stored to it otherwise, under the key of the pattern and text of each pair.
+ * If cutoff is not null, only the pairs with a similarity greater than its minimum are returned,
+ * so that the memory used grows with the amount of similar pairs instead of the amount of all pairs.
+ */
+AllPairsTiles match_all_pairs(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const match_length_t& init_search_length,
+        const std::size_t& block_size = default_all_pairs_block_size,
+        const HashingMode& hashing_mode = HashingMode::rolling,
+        ResultCache* cache = nullptr,
+        const SimilarityCutoff* cutoff = nullptr) noexcept;
+
+/*
+ * Resumable match_all_pairs, for consumers that process the pairs in order of a and b and need not keep all of them.
+ * Each call to next matches the pairs of the documents a in the next block with all documents b > a, and appends them ordered by a and b.
+ * The concatenation of all pairs returned by next equals the return value of match_all_pairs with the same arguments.
+ * The documents and the cutoff are copied, cache must stay valid until the stream is destroyed.
+ */
+class AllPairsStream {
+public:
+    AllPairsStream(
+            const std::vector<std::pair<std::string, std::string> >& documents,
+            const match_length_t& init_search_length,
+            const std::size_t& block_size = default_all_pairs_block_size,
+            const HashingMode& hashing_mode = HashingMode::rolling,
+            ResultCache* cache = nullptr,
+            const SimilarityCutoff* cutoff = nullptr) noexcept;
+
+    AllPairsStream(const AllPairsStream&) = delete;
+    AllPairsStream& operator=(const AllPairsStream&) = delete;
+
+    // Append the kept pairs of the next block of documents a to pairs, return false if all blocks have been matched
+    bool next(AllPairsTiles& pairs) noexcept;
+
+    // True if all blocks have been matched, so that next returns false
+    bool finished() const noexcept;
+
+private:
+    const std::vector<std::pair<std::string, std::string> > documents;
+    const match_length_t init_search_length;
+    ResultCache* const cache;
+    const bool has_cutoff;
+    SimilarityCutoff cutoff;
+    std::vector<PreparedString> prepared;
+    // Block i contains the documents from block_begins[i] to block_begins[i + 1]
+    std::vector<std::size_t> block_begins;
+    std::size_t next_block = 0;
+};
+
+#endif // ALL_PAIRS_H
@@ -1,25 +1,50 @@
 #ifndef DATA_GENERATOR_HPP
 #define DATA_GENERATOR_HPP
+#include <algorithm>
+#include <cmath>
 #include <random>
+#include <string>
+#include <vector>
 
-// Each translation unit will have its own PRNG state
-static std::random_device rd;
-static const auto data_generator_seed = rd();
-static std::default_random_engine e(data_generator_seed);
+// PRNG state shared by all translation units, seeded from a random device
+struct DataGeneratorState {
+    unsigned seed = std::random_device()();
+    std::default_random_engine engine{ seed };
+};
 
-char next_ascii_char() {
+inline DataGeneratorState& data_generator_state() {
+    static DataGeneratorState state;
+    return state;
+}
+
+inline std::default_random_engine& data_generator_engine() {
+    return data_generator_state().engine;
+}
+
+// Current seed of the PRNG, for reproducing failing tests
+inline unsigned data_generator_seed() {
+    return data_generator_state().seed;
+}
+
+// Restart the PRNG from a fixed seed, for reproducible data
+inline void reseed_data_generator(unsigned seed) {
+    data_generator_state().seed = seed;
+    data_generator_engine().seed(seed);
+}
+
+inline char next_ascii_char() {
     static std::uniform_int_distribution<char> random_printable_ascii(33, 126);
-    return random_printable_ascii(e);
+    return random_printable_ascii(data_generator_engine());
 }
 
 template<class T>
-T next_integer(const T& min_val, const T& max_val) {
+inline T next_integer(const T& min_val, const T& max_val) {
     std::uniform_int_distribution<T> random_integer(min_val, max_val);
-    return random_integer(e);
+    return random_integer(data_generator_engine());
 }
 
 template<class T>
-std::string next_string(T text_size) {
+inline std::string next_string(T text_size) {
     std::string text;
     while(text_size-- > 0) {
         text += next_ascii_char();
@@ -28,20 +53,114 @@ std::string next_string(T text_size) {
 }
 
 template<class T>
-std::string next_bitstring(T size, float p) {
+inline std::string next_bitstring(T size, float p) {
+    auto& engine = data_generator_engine();
     std::bernoulli_distribution bernoulli(p);
     std::string s;
     while(size-- > 0) {
-        s += bernoulli(e) ? '1' : '0';
+        s += bernoulli(engine) ? '1' : '0';
     }
     return s;
 }
 
-std::string random_string_copy(const std::string& src, float copy_prob) {
+inline std::string random_string_copy(const std::string& src, float copy_prob) {
+    auto& engine = data_generator_engine();
     std::bernoulli_distribution bernoulli(copy_prob);
     std::string dest;
     for (const auto& c : src) {
-        dest += bernoulli(e) ? c : next_ascii_char();
+        dest += bernoulli(engine) ? c : next_ascii_char();
+    }
+    return dest;
+}
+
+// Random string of printable characters, where the character of rank k is drawn with a probability proportional to 1 / k^exponent
+template<class T>
+inline std::string next_zipf_string(T size, unsigned alphabet_size, double exponent) {
+    auto& engine = data_generator_engine();
+    std::vector<double> weights;
+    for (auto rank = 1u; rank <= alphabet_size; ++rank) {
+        weights.push_back(1.0 / std::pow(rank, exponent));
+    }
+    std::discrete_distribution<unsigned> zipf(weights.begin(), weights.end());
+    std::string s;
+    while (size-- > 0) {
+        s += static_cast<char>(33 + zipf(engine) % 94);
+    }
+    return s;
+}
+
+/*
+ * Random string that resembles a stream of syntax tokens of source code, one character per token.
+ * Statements are drawn from a small set of templates with Zipf-distributed frequencies and nested into blocks,
+ * which produces low entropy, highly repetitive strings.
+ */
+template<class T>
+inline std::string next_code_string(T size) {
+    auto& engine = data_generator_engine();
+    // V variable, N number, C call, ( ) , ; = + < R return, I if, W while, F for, { }
+    static const std::vector<std::string> statements = {
+        "V=V;", "V=N;", "C(V);", "V=C(V,V);", "V=V+N;", "V=V+V;", "C();", "RV;", "C(V,N);", "V=C();",
+    };
+    static const std::vector<std::string> block_headers = { "I(V<V)", "W(V<N)", "F(V=N;V<V;V=V+N)", "I(C(V))" };
+    std::vector<double> weights;
+    for (auto rank = 1u; rank <= statements.size(); ++rank) {
+        weights.push_back(1.0 / rank);
+    }
+    std::discrete_distribution<std::size_t> next_statement(weights.begin(), weights.end());
+    std::uniform_int_distribution<std::size_t> next_block_header(0, block_headers.size() - 1);
+    std::bernoulli_distribution open_block(0.15);
+    std::bernoulli_distribution close_block(0.2);
+
+    std::string s;
+    unsigned depth = 0;
+    while (s.size() < size) {
+        if (open_block(engine)) {
+            s += block_headers[next_block_header(engine)] + "{";
+            ++depth;
+        } else if (depth > 0 and close_block(engine)) {
+            s += "}";
+            --depth;
+        } else {
+            s += statements[next_statement(engine)];
+        }
+    }
+    s.resize(size);
+    return s;
+}
+
+/*
+ * Copy of src with typical plagiarism transformations:
+ * random tokens of src are inserted with probability insert_prob after each token,
+ * reorder_count random pairs of blocks of block_size tokens are swapped,
+ * and in rename_count random spans of block_size tokens one token is consistently replaced with another.
+ */
+template<class T>
+inline std::string plagiarized_copy(const std::string& src, float insert_prob, T reorder_count, T rename_count, T block_size) {
+    auto& engine = data_generator_engine();
+    std::string dest;
+    if (src.empty()) {
+        return dest;
+    }
+    std::bernoulli_distribution insert(insert_prob);
+    std::uniform_int_distribution<std::size_t> src_position(0, src.size() - 1);
+    for (const auto& c : src) {
+        dest += c;
+        if (insert(engine)) {
+            dest += src[src_position(engine)];
+        }
+    }
+    if (dest.size() < 2 * block_size) {
+        return dest;
+    }
+    std::uniform_int_distribution<std::size_t> block_begin(0, dest.size() / block_size - 1);
+    while (reorder_count-- > 0) {
+        const auto a = block_begin(engine) * block_size;
+        const auto b = block_begin(engine) * block_size;
+        std::swap_ranges(dest.begin() + a, dest.begin() + a + block_size, dest.begin() + b);
+    }
+    while (rename_count-- > 0) {
+        const auto begin = dest.begin() + block_begin(engine) * block_size;
+        std::replace(begin, begin + block_size, src[src_position(engine)], next_ascii_char());
     }
     return dest;
 }
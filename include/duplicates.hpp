@@ -0,0 +1,23 @@
+#ifndef DUPLICATES_H
+#define DUPLICATES_H
+#include <string>
+#include <vector>
+
+/*
+ * Equivalence classes of document indexes, each class in ascending order.
+ * The first index of each class is its representative.
+ */
+typedef std::vector<std::vector<std::size_t> > DuplicateClasses;
+
+/*
+ * Group (tokens, marks) pairs into classes of duplicates.
+ * Two documents are duplicates if they have equal tokens and equal marks, missing marks are assumed to be false.
+ * If ignore_marked is true, tokens at marked positions are not compared, i.e. documents that differ only in their marked regions are duplicates.
+ * In both cases, matching any document against a duplicate of another produces the same tiles as matching against the other.
+ * Classes are ordered by their representatives.
+ */
+DuplicateClasses group_duplicates(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const bool& ignore_marked) noexcept;
+
+#endif // DUPLICATES_H
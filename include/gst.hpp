@@ -1,5 +1,7 @@
 #ifndef GST_H
 #define GST_H
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -47,6 +49,21 @@ struct Tile {
 
 typedef std::vector<Tile> Tiles;
 
+/*
+ * Substring hashing strategies of match_strings, which produce equal tiles barring hash collisions.
+ * rolling: rehash both strings with a rolling hash for every search length.
+ * prefix: hash both strings once into prefix hashes, giving the hash of a substring of any length in constant time,
+ *         and keep the substring index of every search length, updating it only at tokens marked after it was built.
+ *         Uses more memory, but avoids rehashing unchanged regions when search lengths are revisited.
+ */
+enum class HashingMode { rolling, prefix };
+
+/*
+ * Version of the tiles returned by match_strings, which is part of the keys of persistent results.
+ * Increment when a change can alter the tiles for some input.
+ */
+constexpr unsigned gst_engine_version = 1u;
+
 
 /*
  * For two given strings, run Karp-Rabin Greedy String tiling and return a vector of Tiles that correspond to matching substrings of maximal length from both strings.
@@ -60,6 +77,101 @@ Tiles match_strings(
         const std::string& text,
         const match_length_t& init_search_length,
         const std::string& init_pattern_marks = "",
-        const std::string& init_text_marks = "") noexcept;
+        const std::string& init_text_marks = "",
+        const HashingMode& hashing_mode = HashingMode::rolling) noexcept;
+
+/*
+ * Resumable match_strings, for consumers that may stop before all tiles have been found.
+ * Each call to next runs the matching loop until a pass of markarrays creates new tiles, and appends them longest first.
+ * The concatenation of all tiles returned by next contains the same tiles as match_strings with the same arguments.
+ * No matching is done after the consumer stops calling next.
+ */
+class TileStream {
+public:
+    TileStream(
+            const std::string& pattern,
+            const std::string& text,
+            const match_length_t& init_search_length,
+            const std::string& init_pattern_marks = "",
+            const std::string& init_text_marks = "",
+            const HashingMode& hashing_mode = HashingMode::rolling) noexcept;
+    ~TileStream();
+
+    TileStream(const TileStream&) = delete;
+    TileStream& operator=(const TileStream&) = delete;
+
+    // Append the tiles of the next pass that creates tiles to new_tiles, return false if no tiles are left
+    bool next(Tiles& new_tiles) noexcept;
+
+    // True if no tiles are left, so that next returns false
+    bool finished() const noexcept;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+/*
+ * Rolling hashes of the substrings of one length of a string by starting position, see window_fingerprints.
+ */
+typedef std::vector<std::uint32_t> WindowFingerprints;
+
+/*
+ * A string with initial marks, tokenized once for matching against many other strings with match_prepared.
+ * With HashingMode::prefix, the prefix hashes are computed once as well, since they do not depend on marks.
+ */
+class PreparedString {
+public:
+    PreparedString(
+            const std::string& str,
+            const std::string& init_marks = "",
+            const HashingMode& hashing_mode = HashingMode::rolling) noexcept;
+    // String for HashingMode::rolling with the window_fingerprints of str for window_length, e.g. from batch_window_fingerprints,
+    // which replace rehashing the string in the passes of match_prepared at search length window_length
+    PreparedString(
+            const std::string& str,
+            const std::string& init_marks,
+            WindowFingerprints fingerprints,
+            const match_length_t& window_length) noexcept;
+    PreparedString(PreparedString&&) noexcept;
+    ~PreparedString();
+
+    PreparedString(const PreparedString&) = delete;
+    PreparedString& operator=(const PreparedString&) = delete;
+
+    std::size_t size() const noexcept;
+
+    // Approximate amount of memory read when matching against this string, in bytes
+    std::size_t footprint() const noexcept;
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+
+    friend Tiles match_prepared(const PreparedString&, const PreparedString&, const match_length_t&) noexcept;
+};
+
+/*
+ * Same tiles as match_strings for the strings and initial marks of prepared pattern and text.
+ * Prefix hashing is used if both strings were prepared with HashingMode::prefix, else rolling hashing,
+ * with the window fingerprints of the strings in passes at their window length if both have fingerprints of the same length.
+ */
+Tiles match_prepared(
+        const PreparedString& pattern,
+        const PreparedString& text,
+        const match_length_t& init_search_length) noexcept;
+
+/*
+ * Tiles of one query against each of many texts, equal to calling match_strings(query, texts[i].first, init_search_length, init_query_marks, texts[i].second) for every (text, init_text_marks) pair.
+ * Instead of rehashing the query for every text, the windows of the query are hashed into one index per search length,
+ * and the unmarked windows of all texts at that search length are streamed through it, while the marks and tiles of every pair are kept separately.
+ * If shorter_as_pattern is true, texts shorter than the query are matched as the pattern as in matchlib, and their tiles are reported with the query indexes first.
+ */
+std::vector<Tiles> match_one_to_many(
+        const std::string& query,
+        const std::vector<std::pair<std::string, std::string> >& texts,
+        const match_length_t& init_search_length,
+        const std::string& init_query_marks = "",
+        const bool& shorter_as_pattern = false) noexcept;
 
 #endif // GST_H
@@ -0,0 +1,52 @@
+#ifndef PROFILING_H
+#define PROFILING_H
+#include <cstddef>
+
+/*
+ * Phases of match_strings for attributing heap allocations in instrumented builds.
+ */
+enum class ProfilingPhase : unsigned {
+    other,
+    tokens,
+    hash_index,
+    matches,
+    tiles,
+    count // Amount of phases, not a phase
+};
+
+#ifdef GST_PROFILE_PHASES
+// Attribute all following allocations to phase, defined by the allocation profiler linked into the instrumented build
+void profiling_enter_phase(ProfilingPhase phase) noexcept;
+#define PROFILING_PHASE(phase) profiling_enter_phase(phase)
+#else
+#define PROFILING_PHASE(phase) ((void)0)
+#endif
+
+struct AllocationStats {
+    std::size_t allocations = 0;
+    std::size_t bytes = 0;
+    // Highest amount of live heap bytes above the amount at the last reset
+    std::size_t peak_live_bytes = 0;
+};
+
+/*
+ * Allocation profiler API, implemented by tests/allocation_profiler.cpp,
+ * which replaces the global operator new and delete with counting versions.
+ */
+
+// Reset all counters and enter ProfilingPhase::other
+void profiling_reset() noexcept;
+
+// Counters of all allocations since the last reset
+AllocationStats profiling_total() noexcept;
+
+// Counters of allocations made during the given phase since the last reset
+AllocationStats profiling_phase(ProfilingPhase phase) noexcept;
+
+// Reset the peak resident set size to the current one, return false if the system does not support it
+bool profiling_reset_peak_rss() noexcept;
+
+// Peak resident set size in kilobytes since the last successful profiling_reset_peak_rss, or of the process
+std::size_t profiling_peak_rss_kb() noexcept;
+
+#endif // PROFILING_H
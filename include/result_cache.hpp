@@ -0,0 +1,79 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "gst.hpp"
+#include "sha256.hpp"
+
+typedef Digest CacheKey;
+
+/*
+ * Key of the tiles of match_strings for the given arguments and gst_engine_version.
+ * Marks are compared as in match_strings, so missing marks and explicit zeros give the same key.
+ */
+CacheKey result_cache_key(
+        const std::string& pattern,
+        const std::string& text,
+        const match_length_t& init_search_length,
+        const std::string& init_pattern_marks = "",
+        const std::string& init_text_marks = "") noexcept;
+
+/*
+ * Persistent store of match_strings results in a single append-only file, shared by any amount of processes on one host.
+ * Records are appended under an exclusive lock of the file and read through a memory mapping.
+ * An in-memory index of the records is extended with the records of other processes when a key is not found.
+ * Every record has a checksum, and a partially written record left by a crashed writer is truncated by the next writer.
+ */
+class ResultCache {
+public:
+    // Open or create the cache file at path, throw std::system_error on I/O errors and std::invalid_argument if the file is not a cache
+    explicit ResultCache(const std::string& path);
+    ~ResultCache();
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Copy the tiles stored for key to tiles and return true, or return false if there are none
+    bool find(const CacheKey& key, Tiles& tiles);
+
+    // Store the tiles for key unless they have already been stored, return false on I/O errors
+    bool insert(const CacheKey& key, const Tiles& tiles);
+
+    // Return the tiles of match_strings with the given arguments, matching and storing them if they are not in the cache
+    Tiles match(
+            const std::string& pattern,
+            const std::string& text,
+            const match_length_t& init_search_length,
+            const std::string& init_pattern_marks = "",
+            const std::string& init_text_marks = "");
+
+    // Amount of stored results
+    std::size_t size();
+
+private:
+    struct KeyHash {
+        std::size_t operator()(const CacheKey& key) const noexcept;
+    };
+
+    struct Location {
+        std::uint64_t offset;
+        std::uint32_t size;
+    };
+
+    // Index the records appended after the end of the indexed records, the file must be locked
+    void refresh() noexcept;
+    // Map at least the first size bytes of the file
+    bool map(const std::uint64_t& size) noexcept;
+
+    int fd;
+    const char* mapping = nullptr;
+    std::uint64_t mapped_size = 0;
+    // End of the last valid record
+    std::uint64_t indexed_end;
+    std::unordered_map<CacheKey, Location, KeyHash> index;
+    std::mutex mutex;
+};
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,34 @@
+#ifndef SHA256_H
+#define SHA256_H
+#include <array>
+#include <cstdint>
+#include <string>
+
+typedef std::array<std::uint8_t, 32> Digest;
+
+/*
+ * Incremental SHA-256 (FIPS 180-4), for keys that must not collide between different inputs.
+ */
+class Sha256 {
+public:
+    Sha256() noexcept;
+
+    void update(const void* data, std::size_t size) noexcept;
+
+    void update(const std::string& data) noexcept {
+        update(data.data(), data.size());
+    }
+
+    // Return the digest of all data given to update, after which the hasher must not be updated
+    Digest digest() noexcept;
+
+private:
+    void compress(const std::uint8_t* block) noexcept;
+
+    std::array<std::uint32_t, 8> state;
+    std::array<std::uint8_t, 64> buffer;
+    std::size_t buffer_size;
+    std::uint64_t total_size;
+};
+
+#endif // SHA256_H
@@ -0,0 +1,82 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gst.hpp"
+
+typedef std::uint32_t sketch_hash_t;
+
+/*
+ * MinHash signatures contain the minimum value of each hash function over all k-grams of a string.
+ * An empty signature denotes a string without any unmarked k-grams.
+ */
+typedef std::vector<sketch_hash_t> Signature;
+
+/*
+ * For a given string, compute a MinHash signature of num_hashes values from the rolling hashes of all its substrings of length kgram_length.
+ * The k-grams are hashed with the same rolling hash scanpatterns uses, and k-grams containing marked characters are skipped.
+ * Marks are given as a string of zeros and ones, missing marks are assumed to be false.
+ */
+Signature minhash_signature(
+        const std::string& tokens,
+        const std::string& marks,
+        const match_length_t& kgram_length,
+        const std::size_t& num_hashes) noexcept;
+
+/*
+ * Estimate the Jaccard similarity of the k-gram sets of two strings from their MinHash signatures.
+ */
+double estimate_jaccard(const Signature& a, const Signature& b) noexcept;
+
+/*
+ * Candidate pairs contain the indexes of two similar strings, a < b, and their estimated Jaccard similarity.
+ */
+struct CandidatePair {
+    const std::size_t a;
+    const std::size_t b;
+    const double similarity;
+};
+
+typedef std::vector<CandidatePair> CandidatePairs;
+
+/*
+ * Locality-sensitive hashing index over MinHash signatures.
+ * Each signature is split into bands of rows consecutive values, and two signatures that are equal in at least one band become a candidate pair.
+ * The probability of becoming a candidate pair is 1 - (1 - s^rows)^bands for a pair with Jaccard similarity s.
+ */
+class LSHIndex {
+public:
+    LSHIndex(const std::size_t& bands, const std::size_t& rows);
+
+    // Add a signature of length bands * rows to the index and return its index
+    std::size_t insert(Signature signature);
+
+    // Return all pairs of inserted signatures that share a band and have an estimated similarity of at least threshold
+    CandidatePairs candidate_pairs(const double& threshold) const;
+
+    std::size_t size() const noexcept {
+        return signatures.size();
+    }
+
+private:
+    const std::size_t bands;
+    const std::size_t rows;
+    std::vector<Signature> signatures;
+    // One bucket map per band, from band hashes to signature indexes
+    std::vector<std::unordered_map<std::uint64_t, std::vector<std::size_t> > > buckets;
+};
+
+/*
+ * Build MinHash signatures for all given (tokens, marks) pairs and return candidate pairs with an estimated Jaccard similarity of at least threshold.
+ * The signature length is bands * rows.
+ */
+CandidatePairs sketch_candidates(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const match_length_t& kgram_length,
+        const double& threshold,
+        const std::size_t& bands,
+        const std::size_t& rows) noexcept;
+
+#endif // SKETCH_H
@@ -0,0 +1,73 @@
+#ifndef TILESET_H
+#define TILESET_H
+#include <map>
+#include <string>
+#include "gst.hpp"
+
+/*
+ * Set of tiles ordered by pattern index, with interval indexes of the tokens covered on the pattern and the text axis.
+ * Tiles overlap if they share at least one token in the pattern or in the text.
+ */
+class TileSet {
+public:
+    typedef std::multimap<match_length_t, Tile>::const_iterator const_iterator;
+
+    // Add a tile without checking for overlaps
+    void add(const Tile& tile);
+
+    // Add a tile if it does not overlap any tile in the set, and return true if it was added
+    bool add_non_overlapping(const Tile& tile);
+
+    // Return true if the tile overlaps some tile in the set, in O(log n) time
+    bool overlaps(const Tile& tile) const noexcept;
+
+    void extend(const TileSet& other);
+
+    void clear() noexcept;
+
+    // Return a new set with the pattern and text indexes of all tiles swapped
+    TileSet reversed() const;
+
+    std::size_t size() const noexcept {
+        return tiles.size();
+    }
+
+    match_length_t token_count() const noexcept {
+        return tokens;
+    }
+
+    // Iterate over all tiles in ascending pattern index order
+    const_iterator begin() const noexcept {
+        return tiles.begin();
+    }
+
+    const_iterator end() const noexcept {
+        return tiles.end();
+    }
+
+    // Compact JSON array of [pattern_index, text_index, match_length] arrays, in ascending pattern index order
+    std::string json() const;
+
+    // Compact binary representation of all tiles, as unsigned LEB128 varints
+    std::string to_bytes() const;
+
+    // Replace all tiles of tileset with the tiles of bytes produced by to_bytes, return false if bytes are malformed
+    static bool from_bytes(const std::string& bytes, TileSet& tileset);
+
+    // Set containing one tile that covers the first length tokens of both strings
+    static TileSet full_match(const match_length_t& length);
+
+private:
+    // Map from the first index of each disjoint covered interval to the index one past its end
+    typedef std::map<match_length_t, match_length_t> Coverage;
+
+    static bool overlaps(const Coverage& coverage, const match_length_t& begin, const match_length_t& end) noexcept;
+    static void cover(Coverage& coverage, match_length_t begin, match_length_t end);
+
+    std::multimap<match_length_t, Tile> tiles;
+    Coverage pattern_coverage;
+    Coverage text_coverage;
+    match_length_t tokens = 0;
+};
+
+#endif // TILESET_H
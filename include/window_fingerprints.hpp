@@ -0,0 +1,35 @@
+#ifndef WINDOW_FINGERPRINTS_H
+#define WINDOW_FINGERPRINTS_H
+#include <string>
+#include <utility>
+#include <vector>
+#include "gst.hpp"
+
+// Amount of strings batch_window_fingerprints hashes together, one for each 32-bit lane of an AVX2 register
+constexpr std::size_t fingerprint_lanes = 8;
+
+/*
+ * Rolling hashes of all substrings of length window_length of str, by starting position.
+ * The hashes are equal to the substring hashes of match_strings with HashingMode::rolling, and to the k-gram hashes of minhash_signature.
+ * Strings shorter than window_length have no fingerprints.
+ */
+WindowFingerprints window_fingerprints(const std::string& str, const match_length_t& window_length) noexcept;
+
+/*
+ * Implementations of the lanes of batch_window_fingerprints, which produce equal fingerprints.
+ * automatic: AVX2 registers if the CPU supports AVX2, else scalar.
+ * scalar: a scalar loop over the lanes, on any CPU.
+ */
+enum class FingerprintLanes { automatic, scalar };
+
+/*
+ * window_fingerprints of the tokens of every (tokens, marks) document, the marks are not used.
+ * Documents of similar length are hashed in groups of fingerprint_lanes, advancing the rolling hashes of a group together
+ * with the given lane implementation.
+ */
+std::vector<WindowFingerprints> batch_window_fingerprints(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const match_length_t& window_length,
+        const FingerprintLanes& lanes = FingerprintLanes::automatic) noexcept;
+
+#endif // WINDOW_FINGERPRINTS_H
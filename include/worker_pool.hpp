@@ -0,0 +1,52 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed size pool of threads that run tasks in submission order.
+ * Tasks are called with false when run by a worker.
+ * Tasks that were still queued when the pool shut down are returned to the caller of shutdown,
+ * which should call them with true.
+ */
+class WorkerPool {
+public:
+    typedef std::function<void(bool)> Task;
+
+    explicit WorkerPool(std::size_t thread_count);
+
+    // Shut down and call pending tasks with true
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Queue a task, return false if the pool has been shut down
+    bool submit(Task task);
+
+    // Stop accepting tasks and wait for all workers to finish.
+    // If run_pending is true, workers run all queued tasks before finishing,
+    // otherwise queued tasks are returned without being called.
+    std::vector<Task> shutdown(bool run_pending);
+
+    std::size_t size() const noexcept {
+        return thread_count;
+    }
+
+private:
+    void work();
+
+    const std::size_t thread_count;
+    std::vector<std::thread> workers;
+    std::deque<Task> tasks;
+    std::mutex tasks_mutex;
+    std::condition_variable tasks_available;
+    bool stopping = false;
+    bool drain = false;
+};
+
+#endif // WORKER_POOL_H
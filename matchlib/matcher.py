@@ -1,54 +1,214 @@
 import itertools
 
-from matchlib.matchers import greedy_string_tiling
+from gst import ResultCache
+
+from matchlib.matchers import (
+    greedy_string_tiling,
+    all_pairs_greedy_string_tiling,
+    one_to_many_greedy_string_tiling,
+    sketch_candidate_pairs,
+    duplicate_classes,
+)
 from matchlib.util import TokenMatchSet
 
 
 RESULT_KEYS = ["id_a", "id_b", "match_indexes", "similarity"]
 
 
-def _match_all(config, pairs_to_compare):
+def _similarity_formatter(config):
+    similarity_precision = config.get("similarity_precision")
+    return (lambda x: round(x, similarity_precision)) if similarity_precision is not None else (lambda x: x)
+
+
+def _has_too_few_unique_tokens(config, a, b):
+    return max(a["longest_authored_tile"], b["longest_authored_tile"]) < config.get("minimum_match_length", 1)
+
+
+def _duplicate_classes(config, string_data):
+    """
+    Group string data into classes of duplicates, unless disabled by setting group_duplicates to False in config.
+    If group_ignored_duplicates is True in config, string data that differ only in their ignored tokens are also duplicates.
+    """
+    if not config.get("group_duplicates", True):
+        return [[i] for i in range(len(string_data))]
+    return duplicate_classes(string_data, config.get("group_ignored_duplicates", False))
+
+
+def _result_cache(config):
+    """
+    Open the persistent result cache at result_cache_path in config, or return None if no path is configured.
+    The cache file may be shared by all workers on one host.
+    """
+    path = config.get("result_cache_path")
+    return None if path is None else ResultCache(path)
+
+
+def _class_of(classes, size):
+    """
+    Return a list mapping each string data index to the index of its duplicate class.
+    """
+    class_of = [0] * size
+    for class_index, duplicates in enumerate(classes):
+        for i in duplicates:
+            class_of[i] = class_index
+    return class_of
+
+
+class _OrderedPairMatches:
     """
-    Compare all pairs and return an iterator over the matches.
+    Matches of pairs (c, d), c < d, taken as they are needed from an iterator over pairs and their matches in the order of itertools.combinations.
+    Looking up a pair (c, d) takes all pairs of the rows up to c, so that only the pairs of the rows up to the latest row looked up are held.
+    """
+
+    def __init__(self, pair_matches):
+        self._pair_matches = iter(pair_matches)
+        self._next = next(self._pair_matches, None)
+        self._matches = {}
+
+    def _take_rows(self, c):
+        while self._next is not None and self._next[0][0] <= c:
+            pair, matches = self._next
+            self._matches[pair] = matches
+            self._next = next(self._pair_matches, None)
+
+    def __contains__(self, pair):
+        self._take_rows(pair[0])
+        return pair in self._matches
+
+    def pop(self, pair):
+        self._take_rows(pair[0])
+        return self._matches.pop(pair)
+
+
+def _match_all(config, string_data, classes, index_pairs, representative_matches=None, result_cache=None, skip_missing=False):
+    """
+    Compare all pairs (i, j), i < j, of string data indexes in index_pairs and return an iterator over the matches, in the order of index_pairs.
+    Duplicates with identical tokens get a full match without comparing them.
+    All other pairs get the matches of the representatives of their classes, computed once for each ordered pair of classes,
+    so that the indexes into string data i are always first.
+    If the class of j comes first, the matches of the reversed pair of classes are reused and reversed,
+    unless both representatives are equally long, because greedy_string_tiling then makes the first of them the pattern.
+    Duplicates that differ only in ignored tokens get the matches of their representative with itself.
+    If representative_matches is given, it maps pairs of classes (c, d), c < d, to the matches of their representatives computed in advance,
+    entries are removed when they are used. It may be an _OrderedPairMatches, since the pairs of classes are first used in the order of c.
+    If skip_missing is True, the pairs of classes c < d missing from representative_matches are known to be below the minimum similarity and skipped.
     """
     minimum_match_length = config.get("minimum_match_length", 1)
     minimum_similarity = config.get("minimum_similarity", -1)
-    similarity_precision = config.get("similarity_precision")
-    optional_round = (lambda x: round(x, similarity_precision)) if similarity_precision is not None else (lambda x: x)
-    for a, b, in pairs_to_compare:
-        if max(a["longest_authored_tile"], b["longest_authored_tile"]) < minimum_match_length:
-            # Skip pairs that have too few unique tokens
+    optional_round = _similarity_formatter(config)
+    class_of = _class_of(classes, len(string_data))
+    # Matches of the class representatives and their JSON, by ordered pair of classes, kept while other class members may use them
+    class_pair_matches = {}
+
+    def representative_pair_matches(class_a, class_b):
+        if (class_a, class_b) in class_pair_matches:
+            return class_pair_matches[class_a, class_b]
+        rep_a, rep_b = string_data[classes[class_a][0]], string_data[classes[class_b][0]]
+        rep_tokens_a, rep_tokens_b = rep_a["tokens"], rep_b["tokens"]
+        if class_b < class_a and len(rep_tokens_a) != len(rep_tokens_b):
+            reversed_result = representative_pair_matches(class_b, class_a)
+            if reversed_result is None:
+                return None
+            matches = reversed_result[0].reverse()
+        elif representative_matches is not None and (class_a, class_b) in representative_matches:
+            matches = representative_matches.pop((class_a, class_b))
+        elif skip_missing and class_a < class_b:
+            return None
+        else:
+            # Compare unique syntax tokens of the representatives, ignoring marked tokens
+            # If no marks are given, assume no tokens are marked
+            marks_a = rep_a.get("ignore_marks", '0' * len(rep_tokens_a))
+            marks_b = rep_b.get("ignore_marks", '0' * len(rep_tokens_b))
+            matches = greedy_string_tiling(rep_tokens_a, marks_a, rep_tokens_b, marks_b, minimum_match_length, result_cache)
+        result = matches, matches.json()
+        if len(classes[class_a]) > 1 or len(classes[class_b]) > 1:
+            class_pair_matches[class_a, class_b] = result
+        return result
+
+    for i, j in index_pairs:
+        a, b = string_data[i], string_data[j]
+        if _has_too_few_unique_tokens(config, a, b):
             continue
         # Get the string pair that will be compared
         tokens_a, tokens_b = a["tokens"], b["tokens"]
-        if "checksum" in a and "checksum" in b and a["checksum"] == b["checksum"]:
+        if ("checksum" in a and "checksum" in b and a["checksum"] == b["checksum"]) or (class_of[i] == class_of[j] and tokens_a == tokens_b):
             # Skip syntax token matching and create a full match of all tokens
-            matches = TokenMatchSet.full_match_from_length(min(len(tokens_a), len(tokens_b)))
+            full_matches = TokenMatchSet.full_match_from_length(min(len(tokens_a), len(tokens_b)))
             # Match of all tokens
             similarity = 1.0
-        else:
-            # Compare unique syntax tokens, ignoring marked tokens
-            # If no marks are given, assume no tokens are marked
-            marks_a = a.get("ignore_marks", '0' * len(tokens_a))
-            marks_b = b.get("ignore_marks", '0' * len(tokens_b))
-            matches = greedy_string_tiling(tokens_a, marks_a, tokens_b, marks_b, minimum_match_length)
-            avg_unique_tokens = (a["authored_token_count"] + b["authored_token_count"]) / 2
-            similarity = matches.token_count() / avg_unique_tokens if avg_unique_tokens > 0 else 0
+            if similarity > minimum_similarity:
+                yield [a["id"], b["id"], full_matches.json(), optional_round(similarity)]
+            continue
+        result = representative_pair_matches(class_of[i], class_of[j])
+        if result is None:
+            continue
+        matches, matches_json = result
+        avg_unique_tokens = (a["authored_token_count"] + b["authored_token_count"]) / 2
+        similarity = matches.token_count() / avg_unique_tokens if avg_unique_tokens > 0 else 0
         if similarity > minimum_similarity:
-            yield [a["id"], b["id"], matches.json(), optional_round(similarity)]
+            yield [a["id"], b["id"], matches_json, optional_round(similarity)]
 
 
 def match_all_combinations(config, string_data_iter):
     """
     Given a configuration dict and an iterable of string data, do string similarity comparisons for all 2-combinations without replacement for the input data.
-    Return an iterator over matches.
+    Duplicates are grouped into classes and only the class representatives are compared, see _duplicate_classes.
+    All pairs of representatives are compared in blocks of about all_pairs_block_size bytes of documents, 128 KiB by default.
+    If the configuration contains a sketch_threshold, only pairs with an estimated k-gram Jaccard similarity of at least sketch_threshold are compared.
+    Return an iterator over matches, in the order of itertools.combinations of the input data.
     """
-    return _match_all(config, itertools.combinations(string_data_iter, 2))
+    string_data = list(string_data_iter)
+    classes = _duplicate_classes(config, string_data)
+    sketch_threshold = config.get("sketch_threshold")
+    representatives = [string_data[duplicates[0]] for duplicates in classes]
+    result_cache = _result_cache(config)
+    representative_matches = None
+    skip_missing = False
+    if sketch_threshold is None:
+        # Match all pairs of representatives natively, in blocks that stay in the CPU cache, one block of rows at a time as the pairs are needed.
+        # Pairs of classes below the minimum similarity are dropped natively, weighting every class by the fewest authored tokens of its members,
+        # which gives the highest similarity of any pair of members, unless a class has members with and without authored tokens
+        minimum_similarity = config.get("minimum_similarity")
+        weights = None
+        if minimum_similarity is not None:
+            authored_token_counts = [[string_data[i]["authored_token_count"] for i in duplicates] for duplicates in classes]
+            weights = [min(counts) for counts in authored_token_counts]
+            skip_missing = all(min(counts) > 0 or max(counts) == 0 for counts in authored_token_counts)
+        representative_matches = _OrderedPairMatches(all_pairs_greedy_string_tiling(
+                representatives,
+                config.get("minimum_match_length", 1),
+                config.get("all_pairs_block_size", 128 * 1024),
+                result_cache,
+                minimum_similarity if skip_missing else None,
+                weights if skip_missing else None))
+        index_pairs = itertools.combinations(range(len(string_data)), 2)
+    else:
+        kgram_length = config.get("sketch_kgram_length", config.get("minimum_match_length", 1))
+        class_pairs = sketch_candidate_pairs(representatives, kgram_length, sketch_threshold)
+        # All pairs of duplicates and of the members of candidate classes, in input order
+        index_pairs = [pair for duplicates in classes for pair in itertools.combinations(duplicates, 2)]
+        for class_a, class_b in class_pairs:
+            index_pairs.extend((min(i, j), max(i, j)) for i in classes[class_a] for j in classes[class_b])
+        index_pairs.sort()
+    return _match_all(config, string_data, classes, index_pairs, representative_matches, result_cache, skip_missing)
 
 
 def match_to_others(config, string_data, other_data_iter):
     """
     Compare one string data object to all other objects in other_data_iter.
-    Return an iterator over matches.
+    Duplicates are grouped into classes and only the class representatives are compared, see _duplicate_classes.
+    Without a result cache, the tokens of the string data object are hashed once for all representatives.
+    Return an iterator over matches, in the order of other_data_iter.
     """
-    return _match_all(config, ((string_data, other_data) for other_data in other_data_iter))
+    string_data = [string_data] + list(other_data_iter)
+    classes = _duplicate_classes(config, string_data)
+    # The first class contains the string data object to be compared and its duplicates
+    class_pairs = [(0, c) for c in range(1, len(classes))]
+    result_cache = _result_cache(config)
+    representative_matches = None
+    if result_cache is None:
+        representatives = [string_data[classes[c][0]] for _, c in class_pairs]
+        all_matches = one_to_many_greedy_string_tiling(string_data[0], representatives, config.get("minimum_match_length", 1))
+        representative_matches = dict(zip(class_pairs, all_matches))
+    index_pairs = ((0, j) for j in range(1, len(string_data)))
+    return _match_all(config, string_data, classes, index_pairs, representative_matches, result_cache)
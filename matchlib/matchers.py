@@ -1,15 +1,19 @@
 from gst import match as match_c_ext
+from gst import sketch_candidates as sketch_candidates_c_ext
+from gst import group_duplicates as group_duplicates_c_ext
+from gst import match_all_pairs_iter as match_all_pairs_iter_c_ext
+from gst import match_one_to_many as match_one_to_many_c_ext
 
-from matchlib.util import TokenMatch, TokenMatchSet
+from matchlib.util import TokenMatchSet
 
 
-def greedy_string_tiling(tokens_a, marks_a, tokens_b, marks_b, min_length):
+def greedy_string_tiling(tokens_a, marks_a, tokens_b, marks_b, min_length, result_cache=None):
     """
     Wrapper of the C++ extension gst.match, which implements the Running Karp-Rabin Greedy String Tiling algorithm by Michael J. Wise.
+    If a gst.ResultCache is given, results are read from and stored to it.
     """
-    matches = TokenMatchSet()
     if len(tokens_a) < min_length or len(tokens_b) < min_length:
-        return matches
+        return TokenMatchSet()
 
     # Choose the shorter token string to be the pattern and the longer as text
     reverse = len(tokens_b) < len(tokens_a)
@@ -18,11 +22,48 @@ def greedy_string_tiling(tokens_a, marks_a, tokens_b, marks_b, min_length):
     pattern_marks = marks_b if reverse else marks_a
     text_marks = marks_a if reverse else marks_b
 
-    match_list = match_c_ext(pattern, pattern_marks, text, text_marks, min_length)
+    match = match_c_ext if result_cache is None else result_cache.match
+    match_list = match(pattern, pattern_marks, text, text_marks, min_length)
 
-    if reverse:
-        matches.store = [TokenMatch(match[1], match[0], match[2]) for match in match_list]
-    else:
-        matches.store = [TokenMatch(*match) for match in match_list]
+    matches = TokenMatchSet(match_list)
+    return matches.reverse() if reverse else matches
 
-    return matches
+
+def all_pairs_greedy_string_tiling(string_data, min_length, block_size, result_cache=None, minimum_similarity=None, weights=None):
+    """
+    Wrapper of the C++ extension gst.match_all_pairs_iter, which matches all pairs of string data in cache-sized blocks, one block of rows i at a time.
+    Return an iterator over pairs (i, j), i < j, and their matches, in the order of itertools.combinations, equal to calling greedy_string_tiling on each pair.
+    If minimum_similarity is given, only the pairs whose token count divided by the mean of the weights of i and j is greater than it are included.
+    """
+    documents = [(d["tokens"], d.get("ignore_marks", '0' * len(d["tokens"]))) for d in string_data]
+    pairs = match_all_pairs_iter_c_ext(documents, min_length, block_size, result_cache, minimum_similarity, weights)
+    return (((i, j), TokenMatchSet(match_list)) for i, j, match_list in pairs)
+
+
+def one_to_many_greedy_string_tiling(string_data, other_data, min_length):
+    """
+    Wrapper of the C++ extension gst.match_one_to_many, which hashes the tokens of string_data once for all other string data.
+    Return a list of the matches of string_data and each of other_data, equal to calling greedy_string_tiling on each pair.
+    """
+    tokens = string_data["tokens"]
+    marks = string_data.get("ignore_marks", '0' * len(tokens))
+    documents = [(d["tokens"], d.get("ignore_marks", '0' * len(d["tokens"]))) for d in other_data]
+    return [TokenMatchSet(match_list) for match_list in match_one_to_many_c_ext(tokens, marks, documents, min_length, True)]
+
+
+def sketch_candidate_pairs(string_data, kgram_length, threshold):
+    """
+    Wrapper of the C++ extension gst.sketch_candidates, which screens all pairs of string data with MinHash signatures and locality-sensitive hashing.
+    Return a list of index pairs (i, j), i < j, of string data that have an estimated Jaccard similarity of at least threshold.
+    """
+    documents = [(d["tokens"], d.get("ignore_marks", '0' * len(d["tokens"]))) for d in string_data]
+    return [(i, j) for i, j, _ in sketch_candidates_c_ext(documents, kgram_length, threshold)]
+
+
+def duplicate_classes(string_data, ignore_marked):
+    """
+    Wrapper of the C++ extension gst.group_duplicates.
+    Return a list of classes of duplicate string data, each a list of indexes into string_data with the class representative first.
+    """
+    documents = [(d["tokens"], d.get("ignore_marks", '0' * len(d["tokens"]))) for d in string_data]
+    return group_duplicates_c_ext(documents, ignore_marked)
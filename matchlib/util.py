@@ -1,42 +1,88 @@
 import json
 
+from gst import TileSet
 
-class TokenMatchSet:
 
-    def __init__(self):
-        self.store = []
+class TokenMatchSet:
+    """
+    Matches in insertion order, accessible as the list of TokenMatch objects store.
+    The matches are kept in a gst.TileSet of the C++ extension, which checks overlaps in O(log n) time and counts and serializes tokens natively,
+    until store is first accessed, after which store is the only copy of the matches, as it may be modified in place.
+    Matches overlap if they share at least one index in a or in b.
+    """
+
+    def __init__(self, tiles=()):
+        # (a, b, length) tuples in insertion order and their TileSet, or None after store was accessed
+        self._tiles = list(tiles)
+        self._tileset = TileSet(self._tiles)
+        self._store = None
+
+    @property
+    def store(self):
+        if self._tileset is not None:
+            self._store = [TokenMatch(*tile) for tile in self._tiles]
+            self._tiles = self._tileset = None
+        return self._store
+
+    @store.setter
+    def store(self, matches):
+        self._store = matches
+        self._tiles = self._tileset = None
+
+    def _matches(self):
+        return self._store if self._tileset is None else (TokenMatch(*tile) for tile in self._tiles)
 
     def extend(self, match_set):
-        self.store.extend(match_set.store)
+        for match in match_set._matches():
+            self.add(match)
 
     def add(self, match):
-        self.store.append(match)
+        if self._tileset is None:
+            self._store.append(match)
+        else:
+            self._tiles.append((match.a, match.b, match.length))
+            self._tileset.add(match.a, match.b, match.length)
 
     def add_non_overlapping(self, match):
-        if any(match.overlaps(m) for m in self.store):
+        if self._tileset is None:
+            if any(m.a < match.a + match.length and match.a < m.a + m.length
+                   or m.b < match.b + match.length and match.b < m.b + m.length for m in self._store):
+                return False
+            self._store.append(match)
+            return True
+        if not self._tileset.add_non_overlapping(match.a, match.b, match.length):
             return False
-        self.store.append(match)
+        self._tiles.append((match.a, match.b, match.length))
         return True
 
     def clear(self):
-        del self.store[:]
+        if self._tileset is None:
+            del self._store[:]
+        else:
+            del self._tiles[:]
+            self._tileset.clear()
 
     def all(self):
         return self.store
 
     def reverse(self):
-        r = TokenMatchSet()
-        r.store.extend(m.reversed() for m in self.store)
-        return r
+        if self._tileset is None:
+            r = TokenMatchSet()
+            for m in self._store:
+                r.add(m.reversed())
+            return r
+        return TokenMatchSet((b, a, length) for a, b, length in self._tiles)
 
     def match_count(self):
-        return len(self.store)
+        return len(self._store) if self._tileset is None else len(self._tiles)
 
     def token_count(self):
-        return sum(m.length for m in self.store)
+        return sum(m.length for m in self._store) if self._tileset is None else self._tileset.token_count()
 
     def json(self):
-        sorted_match_list = [[m.a, m.b, m.length] for m in sorted(self.store, key=lambda m: m.a)]
+        if self._tileset is not None:
+            return self._tileset.json()
+        sorted_match_list = [[m.a, m.b, m.length] for m in sorted(self._store, key=lambda m: m.a)]
         return json.dumps(sorted_match_list, separators=(",", ":"))
 
     @classmethod
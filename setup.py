@@ -61,6 +61,14 @@ gstmodule = setuptools.Extension(
     sources=[
         # Implementation
         os.path.join('src', 'gst.cpp'),
+        os.path.join('src', 'sketch.cpp'),
+        os.path.join('src', 'duplicates.cpp'),
+        os.path.join('src', 'tileset.cpp'),
+        os.path.join('src', 'worker_pool.cpp'),
+        os.path.join('src', 'sha256.cpp'),
+        os.path.join('src', 'result_cache.cpp'),
+        os.path.join('src', 'all_pairs.cpp'),
+        os.path.join('src', 'window_fingerprints.cpp'),
         # CPython wrapper
         os.path.join('src', 'gstmodule.cpp'),
     ],
@@ -68,7 +76,8 @@ gstmodule = setuptools.Extension(
         "include",
         os.path.join(THIRD_PARTY_DIR, "rollinghashcpp")
     ],
-    extra_compile_args=["--std=c++14"],
+    extra_compile_args=["--std=c++14", "-pthread"],
+    extra_link_args=["-pthread"],
 )
 
 
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <tuple>
+#include "all_pairs.hpp"
+#include "window_fingerprints.hpp"
+
+
+// True if the tiles of documents a and b are similar enough to be kept, where weights has one weight per document
+static bool is_above_cutoff(const Tiles& tiles, const std::size_t& a, const std::size_t& b,
+        const double& minimum_similarity, const std::vector<std::size_t>& weights) noexcept {
+    std::size_t tokens_tiled = 0;
+    for (const auto& tile : tiles) {
+        tokens_tiled += tile.match_length;
+    }
+    const double mean_weight = static_cast<double>(weights[a] + weights[b]) / 2;
+    const double similarity = mean_weight > 0 ? tokens_tiled / mean_weight : 0.0;
+    return similarity > minimum_similarity;
+}
+
+
+static Tiles match_pair(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const std::vector<PreparedString>& prepared,
+        const std::size_t& a,
+        const std::size_t& b,
+        const match_length_t& init_search_length,
+        ResultCache* cache) noexcept {
+    const bool reverse = prepared[b].size() < prepared[a].size();
+    const auto& pattern = reverse ? b : a;
+    const auto& text = reverse ? a : b;
+
+    Tiles tiles;
+    if (cache == nullptr) {
+        tiles = match_prepared(prepared[pattern], prepared[text], init_search_length);
+    } else {
+        const auto& key = result_cache_key(
+                documents[pattern].first, documents[text].first, init_search_length, documents[pattern].second, documents[text].second);
+        if (not cache->find(key, tiles)) {
+            tiles = match_prepared(prepared[pattern], prepared[text], init_search_length);
+            cache->insert(key, tiles);
+        }
+    }
+    if (not reverse) {
+        return tiles;
+    }
+
+    Tiles reversed;
+    reversed.reserve(tiles.size());
+    for (const auto& tile : tiles) {
+        reversed.push_back({ tile.text_index, tile.pattern_index, tile.match_length });
+    }
+    return reversed;
+}
+
+
+AllPairsStream::AllPairsStream(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const match_length_t& init_search_length,
+        const std::size_t& block_size,
+        const HashingMode& hashing_mode,
+        ResultCache* cache,
+        const SimilarityCutoff* cutoff) noexcept :
+    documents(documents),
+    init_search_length(init_search_length),
+    cache(cache),
+    has_cutoff(cutoff != nullptr),
+    cutoff(cutoff != nullptr ? *cutoff : SimilarityCutoff{ 0.0, {} }) {
+    const auto& document_count = documents.size();
+    if (has_cutoff and this->cutoff.weights.empty()) {
+        for (const auto& document : documents) {
+            const auto& marked = std::count(document.second.begin(), document.second.begin() + std::min(document.first.size(), document.second.size()), '1');
+            this->cutoff.weights.push_back(document.first.size() - marked);
+        }
+    }
+
+    prepared.reserve(document_count);
+    if (hashing_mode == HashingMode::rolling) {
+        // Hash the windows of all documents in one batch, for the passes at the initial search length of all their pairs
+        auto fingerprints = batch_window_fingerprints(documents, init_search_length);
+        for (auto i = 0u; i < document_count; ++i) {
+            prepared.emplace_back(documents[i].first, documents[i].second, std::move(fingerprints[i]), init_search_length);
+        }
+    } else {
+        for (const auto& document : documents) {
+            prepared.emplace_back(document.first, document.second, hashing_mode);
+        }
+    }
+
+    // Group consecutive documents into blocks
+    block_begins.push_back(0u);
+    std::size_t block_bytes = 0;
+    for (auto i = 0u; i < document_count; ++i) {
+        const auto& footprint = prepared[i].footprint();
+        if (block_bytes > 0 and block_bytes + footprint > block_size) {
+            block_begins.push_back(i);
+            block_bytes = 0;
+        }
+        block_bytes += footprint;
+    }
+    block_begins.push_back(document_count);
+}
+
+
+bool AllPairsStream::next(AllPairsTiles& pairs) noexcept {
+    if (finished()) {
+        return false;
+    }
+    const auto block_a = next_block++;
+
+    // Pairs are kept in the order they are matched, and sorted by a and b at the end
+    std::vector<PairTiles> kept_pairs;
+    for (auto block_b = block_a; block_b + 1 < block_begins.size(); ++block_b) {
+        for (auto a = block_begins[block_a]; a < block_begins[block_a + 1]; ++a) {
+            for (auto b = std::max(a + 1, block_begins[block_b]); b < block_begins[block_b + 1]; ++b) {
+                auto tiles = match_pair(documents, prepared, a, b, init_search_length, cache);
+                if (not has_cutoff or is_above_cutoff(tiles, a, b, cutoff.minimum_similarity, cutoff.weights)) {
+                    kept_pairs.push_back({ a, b, std::move(tiles) });
+                }
+            }
+        }
+    }
+
+    // PairTiles has const members, so the pairs are moved into their sorted positions
+    std::vector<std::size_t> order(kept_pairs.size());
+    for (auto i = 0u; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&kept_pairs](const std::size_t& i, const std::size_t& j) {
+        return std::tie(kept_pairs[i].a, kept_pairs[i].b) < std::tie(kept_pairs[j].a, kept_pairs[j].b);
+    });
+    for (const auto& i : order) {
+        pairs.push_back({ kept_pairs[i].a, kept_pairs[i].b, std::move(kept_pairs[i].tiles) });
+    }
+    return true;
+}
+
+
+bool AllPairsStream::finished() const noexcept {
+    return next_block + 1 >= block_begins.size();
+}
+
+
+AllPairsTiles match_all_pairs(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const match_length_t& init_search_length,
+        const std::size_t& block_size,
+        const HashingMode& hashing_mode,
+        ResultCache* cache,
+        const SimilarityCutoff* cutoff) noexcept {
+    AllPairsStream stream(documents, init_search_length, block_size, hashing_mode, cache, cutoff);
+    AllPairsTiles all_pairs_tiles;
+    if (cutoff == nullptr) {
+        const auto& document_count = documents.size();
+        all_pairs_tiles.reserve(document_count > 1 ? document_count * (document_count - 1) / 2 : 0u);
+    }
+    while (stream.next(all_pairs_tiles)) {}
+    return all_pairs_tiles;
+}
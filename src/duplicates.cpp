@@ -0,0 +1,72 @@
+#include <cstdint>
+#include <unordered_map>
+#include "duplicates.hpp"
+
+
+inline bool is_marked(const std::string& marks, const std::size_t& i) noexcept {
+    return i < marks.size() and marks[i] == '1';
+}
+
+
+// FNV-1a hash over the length, marks and the compared tokens of a document
+static std::uint64_t document_hash(const std::pair<std::string, std::string>& document, const bool& ignore_marked) noexcept {
+    const auto& tokens = document.first;
+    const auto& marks = document.second;
+    std::uint64_t hash = 0xcbf29ce484222325ull ^ tokens.size();
+    for (auto i = 0u; i < tokens.size(); ++i) {
+        const auto mark = is_marked(marks, i);
+        const unsigned char token = (ignore_marked and mark) ? 0u : tokens[i];
+        hash = (hash ^ (token << 1 | mark)) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+
+static bool are_duplicates(
+        const std::pair<std::string, std::string>& a,
+        const std::pair<std::string, std::string>& b,
+        const bool& ignore_marked) noexcept {
+    if (a.first.size() != b.first.size()) {
+        return false;
+    }
+    for (auto i = 0u; i < a.first.size(); ++i) {
+        const auto mark = is_marked(a.second, i);
+        if (mark != is_marked(b.second, i)) {
+            return false;
+        }
+        if (not (ignore_marked and mark) and a.first[i] != b.first[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+DuplicateClasses group_duplicates(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const bool& ignore_marked) noexcept {
+
+    DuplicateClasses classes;
+    // Map from document hashes to the indexes of all classes with that hash
+    std::unordered_map<std::uint64_t, std::vector<std::size_t> > hash_to_classes;
+
+    for (auto i = 0u; i < documents.size(); ++i) {
+        auto& candidate_classes = hash_to_classes[document_hash(documents[i], ignore_marked)];
+        bool found = false;
+        // Resolve hash collisions by comparing to the class representatives
+        for (const auto& class_index : candidate_classes) {
+            auto& duplicates = classes[class_index];
+            if (are_duplicates(documents[duplicates.front()], documents[i], ignore_marked)) {
+                duplicates.push_back(i);
+                found = true;
+                break;
+            }
+        }
+        if (not found) {
+            candidate_classes.push_back(classes.size());
+            classes.push_back({ i });
+        }
+    }
+
+    return classes;
+}
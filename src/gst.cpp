@@ -1,6 +1,12 @@
 #include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <tuple>
 #include <unordered_map>
 #include "gst.hpp"
+#include "profiling.hpp"
+#include "window_fingerprints.hpp"
 #include "cyclichash.h"
 
 
@@ -26,129 +32,649 @@ inline bool all_tokens_match(const Match& match) noexcept {
 }
 
 
+/*
+ * Create a Match from positions in the indexed and the streamed tokens,
+ * such that pattern_it always points to the pattern and text_it to the text.
+ */
+template<bool pattern_is_indexed>
+inline Match make_match(typename Tokens::iterator indexed_it, typename Tokens::iterator streamed_it, const match_length_t& match_length) noexcept {
+    if (pattern_is_indexed) {
+        return { indexed_it, streamed_it, match_length };
+    }
+    return { streamed_it, indexed_it, match_length };
+}
+
+
+/*
+ * Hash map from substring hashes to the starting positions of all unmarked substrings with that hash,
+ * enabling constant time validation of substring mismatches
+ */
+template<class H>
+using WindowIndex = std::unordered_map<H, std::vector<typename Tokens::iterator> >;
+
+
+/*
+ * Window hasher that rehashes the tokens with a rolling hash on every pass.
+ * Windows must be visited in order, starting with first.
+ */
 template<class T>
-inline T scanpatterns(Tokens& pattern_marks, Tokens& text_marks, Matches& matches, const T& search_length) noexcept {
+class RollingWindowHasher {
+public:
+    typedef T hash_type;
 
-    // Create rolling hashers for pattern and text substrings of length search_length,
+    // Create a rolling hasher for substrings of length window_length,
     // with hash value type T, hash value size of 32 bits,
     // and the same random seed 1 (seed 2 is ignored in hashers with hash value sizes less than 64 bits)
-    CyclicHash<T> pattern_hasher(search_length, 1u, 2u, 32u);
-    CyclicHash<T> text_hasher(search_length, 1u, 2u, 32u);
+    explicit RollingWindowHasher(const T& window_length) :
+        hasher(window_length, 1u, 2u, 32u),
+        window_length(window_length) {}
 
-    // Create a hash map of all text substring hashes,
-    // enabling constant time validation of pattern and text substring mismatches
-    std::unordered_map<T, std::vector<typename Tokens::iterator> > text_hash_to_positions;
+    inline T first(typename Tokens::iterator it) noexcept {
+        // Initialize hash using first range
+        hasher.reset();
+        for (auto jt = it; jt != it + window_length; ++jt) {
+            hasher.eat(jt->chr);
+        }
+        return hasher.hashvalue;
+    }
 
-    T maxmatch = 0;
+    inline T next(typename Tokens::iterator it) noexcept {
+        // Update rolling hash
+        hasher.update((it - 1)->chr, (it + window_length - 1)->chr);
+        return hasher.hashvalue;
+    }
 
-    // Forward to first unmarked text position
-    auto text_it_begin = std::find_if(text_marks.begin(), text_marks.end(), is_unmarked);
+private:
+    CyclicHash<T> hasher;
+    const T window_length;
+};
 
-    if (text_it_begin + search_length > text_marks.end()) {
-        // Too close to end of text, cannot create a match here
-        return maxmatch;
+
+/*
+ * Polynomial hashes of all prefixes of a token string modulo the Mersenne prime 2^61 - 1,
+ * giving the hash of any substring in constant time.
+ * Marks do not affect the hashes, so they can be computed once for all passes.
+ */
+class PrefixHashes {
+public:
+    explicit PrefixHashes(const Tokens& tokens) {
+        prefixes.reserve(tokens.size() + 1);
+        powers.reserve(tokens.size() + 1);
+        prefixes.push_back(0u);
+        powers.push_back(1u);
+        for (const auto& token : tokens) {
+            // Shift characters by one to make leading zero characters significant
+            prefixes.push_back(addmod(mulmod(prefixes.back(), base), static_cast<unsigned char>(token.chr) + 1u));
+            powers.push_back(mulmod(powers.back(), base));
+        }
+    }
+
+    // Hash of the substring of length window_length starting at begin
+    inline std::uint64_t window(const std::size_t& begin, const std::size_t& window_length) const noexcept {
+        const auto& shifted_prefix = mulmod(prefixes[begin], powers[window_length]);
+        return addmod(prefixes[begin + window_length], modulus - shifted_prefix);
+    }
+
+private:
+    __extension__ typedef unsigned __int128 uint128_t;
+    static constexpr std::uint64_t modulus = (1ull << 61) - 1;
+    static constexpr std::uint64_t base = 0x5bd1e9955bd1e99ull;
+
+    static inline std::uint64_t mulmod(const std::uint64_t& a, const std::uint64_t& b) noexcept {
+        const uint128_t product = static_cast<uint128_t>(a) * b;
+        return addmod(static_cast<std::uint64_t>(product & modulus), static_cast<std::uint64_t>(product >> 61));
+    }
+
+    static inline std::uint64_t addmod(const std::uint64_t& a, const std::uint64_t& b) noexcept {
+        const auto sum = a + b;
+        return sum >= modulus ? sum - modulus : sum;
+    }
+
+    std::vector<std::uint64_t> prefixes;
+    std::vector<std::uint64_t> powers;
+};
+
+// Definitions of the constants, which mulmod and addmod bind to references
+constexpr std::uint64_t PrefixHashes::modulus;
+constexpr std::uint64_t PrefixHashes::base;
+
+
+/*
+ * Window hasher that looks up substring hashes from precomputed prefix hashes.
+ * Windows can be visited in any order.
+ */
+class PrefixWindowHasher {
+public:
+    typedef std::uint64_t hash_type;
+
+    PrefixWindowHasher(const PrefixHashes& hashes, typename Tokens::iterator tokens_begin, const match_length_t& window_length) :
+        hashes(hashes),
+        tokens_begin(tokens_begin),
+        window_length(window_length) {}
+
+    inline std::uint64_t first(typename Tokens::iterator it) const noexcept {
+        return hashes.window(it - tokens_begin, window_length);
+    }
+
+    inline std::uint64_t next(typename Tokens::iterator it) const noexcept {
+        return hashes.window(it - tokens_begin, window_length);
+    }
+
+private:
+    const PrefixHashes& hashes;
+    const typename Tokens::iterator tokens_begin;
+    const match_length_t window_length;
+};
+
+
+/*
+ * Window hasher that looks up the window fingerprints of tokens, computed earlier for one window length.
+ * Windows can be visited in any order.
+ */
+class FingerprintWindowHasher {
+public:
+    typedef match_length_t hash_type;
+
+    FingerprintWindowHasher(const WindowFingerprints& fingerprints, typename Tokens::iterator tokens_begin) :
+        fingerprints(fingerprints),
+        tokens_begin(tokens_begin) {}
+
+    inline match_length_t first(typename Tokens::iterator it) const noexcept {
+        return fingerprints[it - tokens_begin];
+    }
+
+    inline match_length_t next(typename Tokens::iterator it) const noexcept {
+        return fingerprints[it - tokens_begin];
+    }
+
+private:
+    const WindowFingerprints& fingerprints;
+    const typename Tokens::iterator tokens_begin;
+};
+
+
+/*
+ * Call visit(position, hash) for every unmarked substring of length window_length of tokens, in order.
+ * If visit returns false, stop visiting and return false.
+ */
+template<class Hasher, class Visitor>
+inline bool for_each_unmarked_window(Tokens& tokens, const match_length_t& window_length, Hasher& hasher, Visitor&& visit) noexcept {
+
+    // Forward to first unmarked position
+    auto it_begin = std::find_if(tokens.begin(), tokens.end(), is_unmarked);
+
+    if (it_begin + window_length > tokens.end()) {
+        // Too close to end of tokens, cannot create a match here
+        return true;
     }
 
-    // Compute hash value for each possible unmarked substring of search_length in text and store its starting position
-    for (auto text_it = text_it_begin; text_it + search_length - 1 < text_marks.end(); ++text_it) {
-        if (text_it == text_it_begin) {
-            // Initialize hash using first text range
-            for (auto it = text_it; it != text_it + search_length; ++it) {
-                text_hasher.eat(it->chr);
+    // Position after the last marked token seen so far,
+    // substrings starting before it contain at least 1 marked token
+    auto unmarked_begin = it_begin;
+
+    for (auto it = it_begin; it + window_length - 1 < tokens.end(); ++it) {
+        const auto& hash = (it == it_begin) ? hasher.first(it) : hasher.next(it);
+
+        if (it == it_begin) {
+            for (auto jt = it; jt != it + window_length; ++jt) {
+                if (not is_unmarked(*jt)) {
+                    unmarked_begin = jt + 1;
+                }
             }
-        } else {
-            // Update rolling hash
-            text_hasher.update((text_it - 1)->chr, (text_it + search_length - 1)->chr);
+        } else if (not is_unmarked(*(it + window_length - 1))) {
+            unmarked_begin = it + window_length;
         }
 
         // Skip all strings with at least 1 marked token
-        if (not std::all_of(text_it, text_it + search_length, is_unmarked)) {
+        if (it < unmarked_begin) {
             continue;
         }
 
-        const auto& text_hash_it = text_hash_to_positions.find(text_hasher.hashvalue);
+        if (not visit(it, hash)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        if (text_hash_it == text_hash_to_positions.end()) {
-            // Hash value does not exist, create new vector with text iterator
-            std::vector<typename Tokens::iterator> v_it = { text_it };
-            text_hash_to_positions.emplace(text_hasher.hashvalue, v_it);
-        } else {
-            // Hash value exists, add new starting point for hashed substring
-            text_hash_it->second.push_back(text_it);
+
+// Store the hash value and starting position of each unmarked substring of length search_length of tokens
+template<class Hasher>
+inline void build_index(Tokens& tokens, const match_length_t& search_length, Hasher& hasher,
+        WindowIndex<typename Hasher::hash_type>& index) noexcept {
+    for_each_unmarked_window(tokens, search_length, hasher, [&index](typename Tokens::iterator it, const typename Hasher::hash_type& hash) {
+        index[hash].push_back(it);
+        return true;
+    });
+}
+
+
+// Start of the first substring of length window_length of tokens that contains no marked tokens, or tokens.end() if there is none
+inline typename Tokens::iterator first_unmarked_window(Tokens& tokens, const match_length_t& window_length) noexcept {
+    match_length_t unmarked_run = 0;
+    for (auto it = tokens.begin(); it != tokens.end(); ++it) {
+        unmarked_run = is_unmarked(*it) ? unmarked_run + 1 : 0;
+        if (unmarked_run == window_length) {
+            return it + 1 - window_length;
         }
     }
+    return tokens.end();
+}
 
-    // For each unmarked pattern character, try to find the longest matching substring
 
-    // Forward to first unmarked pattern position
-    auto pattern_it_begin = std::find_if(pattern_marks.begin(), pattern_marks.end(), is_unmarked);
+/*
+ * Stream all unmarked substrings of length search_length of streamed_marks through the index
+ * of unmarked substrings of indexed_marks, and record all matches.
+ *
+ * A match longer than 2 * search_length would contain many smaller matches that are proper subsets of it,
+ * so the pass continues at the length of the long match: only matches at least that long are recorded from then on, with the long match first.
+ * No match found before the long match is that long, so the recorded matches are those of a pass that starts at the length of the long match,
+ * and search_length is set to that length.
+ * Continuing is cheap if most windows have a single candidate, e.g. on near copies. If the windows streamed after the long match
+ * have more candidates on average, e.g. on source code or repetitive strings with large hash buckets,
+ * or if the long match covers most of the strings, rescanning is cheaper, so streaming stops, search_length is left unchanged
+ * and the length of the long match is returned for restarting the pass at that length.
+ *
+ * Matches are recorded in the order of the pattern, i.e. by pattern position and then by text position, as if the pattern was streamed.
+ * If the pattern is indexed, the text is streamed in a different order, so the pass is never continued:
+ * streaming goes on until the long match that comes first in the order of the pattern is known, and its length is returned for restarting.
+ * A long match only spans unmarked tokens, so none can start before the first run of more than 2 * search_length unmarked pattern tokens,
+ * and streaming stops at a long match that starts there, e.g. if the text contains a copy of the pattern.
+ * Otherwise the rest of the text is streamed in search of an earlier one.
+ * If there is no long match, the matches are sorted into the order of the pattern.
+ * Return the length of the longest match.
+ */
+template<class T, bool pattern_is_indexed, class Hasher>
+inline T stream_windows(const WindowIndex<typename Hasher::hash_type>& index, Tokens& indexed_marks, Tokens& streamed_marks,
+        Matches& matches, T& search_length, Hasher& hasher) noexcept {
 
-    if (pattern_it_begin + search_length > pattern_marks.end()) {
-        // Too close to end of pattern, cannot create a match here
+    T maxmatch = 0;
+
+    if (index.empty()) {
+        // No unmarked substrings in indexed tokens, cannot create a match here
         return maxmatch;
     }
 
-    // Starting at the first unmarked pattern character, iterate over rest of the pattern
-    for (auto pattern_it = pattern_it_begin; pattern_it + search_length - 1 < pattern_marks.end(); ++pattern_it) {
+    // Windows are hashed with the initial length, matches are recorded if they are at least pass_length long
+    const T window_length = search_length;
+    T pass_length = search_length;
+    // Indexed positions and token comparisons left after pass_length has been raised, before falling back to restarting the pass.
+    // Every window streamed after the raise adds continuation_credit.
+    constexpr std::size_t continuation_credit = 3;
+    std::size_t work_left = (indexed_marks.size() + streamed_marks.size()) / 16;
 
-        if (pattern_it == pattern_it_begin) {
-            // Initialize hash using first pattern range
-            pattern_hasher.reset();
-            for (auto it = pattern_it; it != pattern_it + search_length; ++it) {
-                pattern_hasher.eat(it->chr);
-            }
-        } else {
-            // Update rolling hash
-            pattern_hasher.update((pattern_it - 1)->chr, (pattern_it + search_length - 1)->chr);
-        }
+    // Indexed positions and lengths of the matches longer than 2 * window_length that start at the previously streamed window, in bucket order.
+    // Such a match continues one token shorter at the next window on the same diagonal,
+    // which avoids comparing the tokens of a long match again for every window inside it.
+    typedef std::pair<typename Tokens::iterator, T> DiagonalMatch;
+    std::vector<DiagonalMatch> previous_matches;
+    std::vector<DiagonalMatch> current_matches;
+    auto previous_streamed_it = streamed_marks.end();
 
-        // Skip all strings with at least 1 marked token
-        if (not std::all_of(pattern_it, pattern_it + search_length, is_unmarked)) {
-            continue;
+    // If the pattern is indexed, the long match that comes first in the order of the pattern so far,
+    // and the start of the first unmarked run of the pattern that is long enough for a long match
+    Match long_match = { indexed_marks.end(), streamed_marks.end(), 0 };
+    const auto& first_long_run_it = pattern_is_indexed ? first_unmarked_window(indexed_marks, 2 * window_length + 1) : indexed_marks.end();
+
+    // For each unmarked streamed character, try to find the longest matching substring
+    const bool completed = for_each_unmarked_window(streamed_marks, window_length, hasher, [&](typename Tokens::iterator streamed_it, const typename Hasher::hash_type& hash) {
+        if (pass_length > window_length) {
+            work_left += continuation_credit;
         }
 
-        // Check if there is a matching text range
-        const auto& text_hash_it = text_hash_to_positions.find(pattern_hasher.hashvalue);
-        if (text_hash_it == text_hash_to_positions.end()) {
+        // Check if there is a matching indexed range
+        const auto& indexed_hash_it = index.find(hash);
+        if (indexed_hash_it == index.end()) {
             // Mismatching hashes, no string match here
-            continue;
+            return true;
         }
 
-        // Iterate over all text positions that share the hash value of current pattern hash
-        for (const auto& hash_it : text_hash_it->second) {
-            // As an optimization, assume there are no hash collisions and skip
-            // all characters in range [0, search_length)
-            // This assumption will be validated later in markarrays
-            auto pattern_jt = pattern_it + search_length;
-            auto text_jt = hash_it + search_length;
-            T matching_chars = search_length;
-
-            // Count the amount of consequtive, unmarked, matching characters
-            while (pattern_jt != pattern_marks.end() and text_jt != text_marks.end()
-                    and is_a_match(*pattern_jt, *text_jt)) {
-                ++matching_chars;
-                ++pattern_jt;
-                ++text_jt;
+        const bool continues_previous = previous_streamed_it + 1 == streamed_it and not previous_matches.empty();
+        auto previous_it = previous_matches.begin();
+        current_matches.clear();
+
+        // Iterate over all indexed positions that share the hash value of current streamed hash
+        for (const auto& hash_it : indexed_hash_it->second) {
+            if (pattern_is_indexed and long_match.match_length > 0 and not (hash_it < long_match.pattern_it)) {
+                // This and all following positions in the bucket come after the long match in the order of the pattern
+                break;
             }
+            T matching_chars = 0;
+            T comparisons = 0;
+            if (continues_previous) {
+                // Bucket positions are in increasing order, so the match on the same diagonal is found by advancing previous_it
+                while (previous_it != previous_matches.end() and previous_it->first + 1 < hash_it) {
+                    ++previous_it;
+                }
+                if (previous_it != previous_matches.end() and previous_it->first + 1 == hash_it) {
+                    matching_chars = previous_it->second - 1;
+                }
+            }
+            if (matching_chars == 0 and pass_length > window_length
+                    and not (static_cast<std::size_t>(streamed_marks.end() - streamed_it) >= pass_length
+                        and static_cast<std::size_t>(indexed_marks.end() - hash_it) >= pass_length
+                        and is_a_match(*(streamed_it + pass_length - 1), *(hash_it + pass_length - 1)))) {
+                // The last token of a match of pass_length does not match, so the match is too short to be recorded
+                matching_chars = window_length;
+            } else if (matching_chars == 0) {
+                // As an optimization, assume there are no hash collisions and skip
+                // all characters in range [0, window_length)
+                // This assumption will be validated later in markarrays
+                auto streamed_jt = streamed_it + window_length;
+                auto indexed_jt = hash_it + window_length;
+                matching_chars = window_length;
 
-            if (matching_chars > 2 * search_length) {
-                // If the match is 'very long' (here an arbitrary 2 * search_length),
-                // it will most likely contain many, smaller matches that are proper subsets of it.
-                // Therefore, stop matching and return the long match length to restart matching
-                return matching_chars;
-            } else {
+                // Count the amount of consequtive, unmarked, matching characters
+                while (streamed_jt != streamed_marks.end() and indexed_jt != indexed_marks.end()
+                        and is_a_match(*streamed_jt, *indexed_jt)) {
+                    ++matching_chars;
+                    ++streamed_jt;
+                    ++indexed_jt;
+                }
+                comparisons = matching_chars - window_length + 1;
+            }
+            if (pass_length > window_length) {
+                work_left -= std::min<std::size_t>(work_left, 1 + comparisons);
+                if (work_left == 0) {
+                    return false;
+                }
+            }
+            if (matching_chars > 2 * window_length) {
+                current_matches.emplace_back(hash_it, matching_chars);
+            }
+
+            if (pattern_is_indexed and matching_chars > 2 * pass_length) {
+                // The pass ends at this long match, unless another one is found earlier in the order of the pattern
+                long_match = make_match<pattern_is_indexed>(hash_it, streamed_it, matching_chars);
+                matches.clear();
+                maxmatch = 0;
+                if (hash_it == first_long_run_it) {
+                    // No long match can come earlier in the order of the pattern
+                    return false;
+                }
+                break;
+            }
+            if (matching_chars > 2 * pass_length) {
+                // If the match is 'very long' (here an arbitrary 2 * pass_length),
+                // continue the pass at its length and drop the shorter matches recorded so far
+                pass_length = matching_chars;
+                matches.clear();
+                maxmatch = 0;
+                if (static_cast<std::size_t>(streamed_marks.end() - streamed_it)
+                        > indexed_marks.size() + streamed_marks.size() - 2 * pass_length) {
+                    // Restarting hashes fewer windows than are left to stream, e.g. if the strings are copies of each other
+                    return false;
+                }
+            }
+            if (matching_chars >= pass_length and long_match.match_length == 0) {
                 // Record a match
-                matches.push_back({ pattern_it, hash_it, matching_chars });
+                matches.push_back(make_match<pattern_is_indexed>(hash_it, streamed_it, matching_chars));
                 maxmatch = std::max(maxmatch, matching_chars);
             }
         }
 
-    }
+        previous_matches.swap(current_matches);
+        previous_streamed_it = streamed_it;
+        return true;
+    });
 
+    if (not completed) {
+        // Restart matching at the length of the long match
+        return pattern_is_indexed ? long_match.match_length : pass_length;
+    }
+    if (pattern_is_indexed) {
+        if (long_match.match_length > 0) {
+            return long_match.match_length;
+        }
+        std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+            return std::tie(a.pattern_it, a.text_it) < std::tie(b.pattern_it, b.text_it);
+        });
+    }
+    search_length = pass_length;
     return maxmatch;
 }
 
 
+/*
+ * Presence filter of window hashes with one bit per hash, using at least 8 bits per inserted hash.
+ * A window whose hash is not present cannot match any inserted window, other windows might.
+ */
+class HashPresenceFilter {
+public:
+    explicit HashPresenceFilter(const std::size_t& capacity) {
+        while ((1ull << bits_log2) < 8 * capacity) {
+            ++bits_log2;
+        }
+        words.assign(((1ull << bits_log2) + 63) / 64, 0u);
+    }
+
+    inline void insert(const std::uint64_t& hash) noexcept {
+        const auto& bit = position(hash);
+        words[bit >> 6] |= 1ull << (bit & 63);
+    }
+
+    inline bool contains(const std::uint64_t& hash) const noexcept {
+        const auto& bit = position(hash);
+        return words[bit >> 6] & (1ull << (bit & 63));
+    }
+
+private:
+    // Fibonacci hashing spreads the bits of small hash values over the whole filter
+    inline std::uint64_t position(const std::uint64_t& hash) const noexcept {
+        return (hash * 0x9e3779b97f4a7c15ull) >> (64 - bits_log2);
+    }
+
+    unsigned bits_log2 = 6;
+    std::vector<std::uint64_t> words;
+};
+
+
+/*
+ * If the first unmarked substrings of length search_length of indexed_marks and streamed_marks start a match
+ * longer than 2 * search_length, return its length for restarting the pass at that length, else 0.
+ * Such a match is the first long match stream_windows finds, since both substrings come first in their bucket and in the stream,
+ * e.g. on copies and near copies. Restarting there hashes nothing at search_length, and the passes at the longer lengths index few windows,
+ * which is cheaper than continuing the pass after indexing all windows at search_length.
+ */
+template<class T>
+inline T first_windows_restart_length(Tokens& indexed_marks, Tokens& streamed_marks, const T& search_length) noexcept {
+    const auto& indexed_it = first_unmarked_window(indexed_marks, search_length);
+    const auto& streamed_it = first_unmarked_window(streamed_marks, search_length);
+    if (indexed_it == indexed_marks.end() or streamed_it == streamed_marks.end()) {
+        return 0;
+    }
+    T matching_chars = 0;
+    for (auto indexed_jt = indexed_it, streamed_jt = streamed_it;
+            indexed_jt != indexed_marks.end() and streamed_jt != streamed_marks.end() and is_a_match(*indexed_jt, *streamed_jt);
+            ++indexed_jt, ++streamed_jt) {
+        ++matching_chars;
+    }
+    return matching_chars > 2 * search_length ? matching_chars : 0;
+}
+
+
+/*
+ * Find all matches of at least search_length between the unmarked substrings of indexed_marks and streamed_marks.
+ * The unmarked substrings of the streamed tokens are hashed first into a presence filter,
+ * and only the substrings of the indexed tokens whose hash is present are indexed.
+ * The substrings left out could never be found when streaming, so the matches are the same as with a full index,
+ * but the index shrinks with the dissimilarity of the strings.
+ * If the first unmarked substrings of both strings start a long match, e.g. on copies,
+ * the pass restarts at its length without hashing the strings at all.
+ * Builds with GST_NO_PRESENCE_FILTER index all substrings, for comparing both in the benchmark.
+ */
+template<class T, bool pattern_is_indexed, class Hasher>
+inline T scan_windows(Tokens& indexed_marks, Tokens& streamed_marks, Matches& matches, T& search_length,
+        const T& streamed_unmarked_count, Hasher& indexed_hasher, Hasher& streamed_hasher) noexcept {
+    typedef typename Hasher::hash_type H;
+    WindowIndex<H> index;
+
+    const auto& restart_length = first_windows_restart_length(indexed_marks, streamed_marks, search_length);
+    if (restart_length > 0) {
+        return restart_length;
+    }
+
+#ifdef GST_NO_PRESENCE_FILTER
+    (void)streamed_unmarked_count;
+    build_index(indexed_marks, search_length, indexed_hasher, index);
+#else
+    HashPresenceFilter filter(streamed_unmarked_count);
+    for_each_unmarked_window(streamed_marks, search_length, streamed_hasher, [&](typename Tokens::iterator, const H& hash) {
+        filter.insert(hash);
+        return true;
+    });
+
+    for_each_unmarked_window(indexed_marks, search_length, indexed_hasher, [&index, &filter](typename Tokens::iterator it, const H& hash) {
+        if (filter.contains(hash)) {
+            index[hash].push_back(it);
+        }
+        return true;
+    });
+#endif
+
+    PROFILING_PHASE(ProfilingPhase::matches);
+    return stream_windows<T, pattern_is_indexed>(index, indexed_marks, streamed_marks, matches, search_length, streamed_hasher);
+}
+
+
+/*
+ * Find all matches of at least search_length between unmarked substrings of pattern and text.
+ * The pattern is indexed if it has fewer than half the unmarked tokens of the text, e.g. when it is mostly tiled, and the text is streamed through it.
+ * Otherwise the text is indexed: the presence filter already keeps the index small on similar strings,
+ * and only streaming the pattern lets a pass continue at a long match instead of restarting.
+ */
+template<class T, class Hasher>
+inline T scanpatterns(Tokens& pattern_marks, Tokens& text_marks, Matches& matches, T& search_length,
+        const T& pattern_unmarked_count, const T& text_unmarked_count, Hasher& pattern_hasher, Hasher& text_hasher) noexcept {
+    PROFILING_PHASE(ProfilingPhase::hash_index);
+    if (2 * pattern_unmarked_count < text_unmarked_count) {
+        return scan_windows<T, true>(pattern_marks, text_marks, matches, search_length, text_unmarked_count, pattern_hasher, text_hasher);
+    }
+    return scan_windows<T, false>(text_marks, pattern_marks, matches, search_length, pattern_unmarked_count, text_hasher, pattern_hasher);
+}
+
+
+/*
+ * Scanner for HashingMode::rolling, which rehashes both strings on every pass.
+ * If the window fingerprints of both strings are given, passes at their window length look them up instead.
+ */
+class RollingScanner {
+public:
+    RollingScanner(Tokens& pattern_marks, Tokens& text_marks) :
+        RollingScanner(pattern_marks, nullptr, text_marks, nullptr, 0u) {}
+
+    RollingScanner(Tokens& pattern_marks, const WindowFingerprints* pattern_fingerprints,
+            Tokens& text_marks, const WindowFingerprints* text_fingerprints, const match_length_t& fingerprint_length) :
+        pattern_marks(pattern_marks),
+        text_marks(text_marks),
+        pattern_fingerprints(pattern_fingerprints),
+        text_fingerprints(text_fingerprints),
+        fingerprint_length(fingerprint_length) {}
+
+    inline match_length_t scan(Matches& matches, match_length_t& search_length,
+            const match_length_t& pattern_unmarked_count, const match_length_t& text_unmarked_count, const Tiles&) noexcept {
+        if (pattern_fingerprints and text_fingerprints and search_length == fingerprint_length) {
+            FingerprintWindowHasher pattern_hasher(*pattern_fingerprints, pattern_marks.begin());
+            FingerprintWindowHasher text_hasher(*text_fingerprints, text_marks.begin());
+            return scanpatterns(pattern_marks, text_marks, matches, search_length, pattern_unmarked_count, text_unmarked_count, pattern_hasher, text_hasher);
+        }
+        RollingWindowHasher<match_length_t> pattern_hasher(search_length);
+        RollingWindowHasher<match_length_t> text_hasher(search_length);
+        return scanpatterns(pattern_marks, text_marks, matches, search_length, pattern_unmarked_count, text_unmarked_count, pattern_hasher, text_hasher);
+    }
+
+private:
+    Tokens& pattern_marks;
+    Tokens& text_marks;
+    const WindowFingerprints* pattern_fingerprints;
+    const WindowFingerprints* text_fingerprints;
+    const match_length_t fingerprint_length;
+};
+
+
+/*
+ * Scanner for HashingMode::prefix.
+ * Both strings are hashed once into prefix hashes, and the substring index of each side and search length is kept between passes.
+ * When an index is reused, only the substrings that overlap tiles created after the index was built are removed from it.
+ */
+class PrefixScanner {
+public:
+    PrefixScanner(Tokens& pattern_marks, Tokens& text_marks) :
+        PrefixScanner(pattern_marks, std::make_shared<const PrefixHashes>(pattern_marks), text_marks, std::make_shared<const PrefixHashes>(text_marks)) {}
+
+    // Scanner using prefix hashes computed earlier for the same tokens, e.g. by a PreparedString
+    PrefixScanner(Tokens& pattern_marks, std::shared_ptr<const PrefixHashes> pattern_hashes,
+            Tokens& text_marks, std::shared_ptr<const PrefixHashes> text_hashes) :
+        pattern{ pattern_marks, std::move(pattern_hashes), {} },
+        text{ text_marks, std::move(text_hashes), {} } {}
+
+    match_length_t scan(Matches& matches, match_length_t& search_length,
+            const match_length_t& pattern_unmarked_count, const match_length_t& text_unmarked_count, const Tiles& tiles) noexcept {
+        PROFILING_PHASE(ProfilingPhase::hash_index);
+        if (pattern_unmarked_count < text_unmarked_count) {
+            const auto& index = updated_index(pattern, search_length, tiles, &Tile::pattern_index);
+            PROFILING_PHASE(ProfilingPhase::matches);
+            PrefixWindowHasher streamed_hasher(*text.hashes, text.tokens.begin(), search_length);
+            return stream_windows<match_length_t, true>(index, pattern.tokens, text.tokens, matches, search_length, streamed_hasher);
+        }
+        const auto& index = updated_index(text, search_length, tiles, &Tile::text_index);
+        PROFILING_PHASE(ProfilingPhase::matches);
+        PrefixWindowHasher streamed_hasher(*pattern.hashes, pattern.tokens.begin(), search_length);
+        return stream_windows<match_length_t, false>(index, text.tokens, pattern.tokens, matches, search_length, streamed_hasher);
+    }
+
+private:
+    struct CachedIndex {
+        WindowIndex<std::uint64_t> index;
+        // Amount of tiles that existed when the index was last updated
+        std::size_t tiles_seen;
+    };
+
+    struct Side {
+        Tokens& tokens;
+        const std::shared_ptr<const PrefixHashes> hashes;
+        std::unordered_map<match_length_t, CachedIndex> indexes;
+    };
+
+    Side pattern;
+    Side text;
+
+    // Return the index of all unmarked substrings of length search_length on the given side, building it if it does not exist
+    const WindowIndex<std::uint64_t>& updated_index(Side& side, const match_length_t& search_length,
+            const Tiles& tiles, const match_length_t Tile::* tile_index) noexcept {
+        auto cached_it = side.indexes.find(search_length);
+        if (cached_it == side.indexes.end()) {
+            auto& cached = side.indexes[search_length];
+            PrefixWindowHasher hasher(*side.hashes, side.tokens.begin(), search_length);
+            build_index(side.tokens, search_length, hasher, cached.index);
+            cached.tiles_seen = tiles.size();
+            return cached.index;
+        }
+
+        auto& cached = cached_it->second;
+        // Remove all substrings that overlap a new tile, since they contain marked tokens now
+        for (auto tile_it = tiles.begin() + cached.tiles_seen; tile_it != tiles.end(); ++tile_it) {
+            const match_length_t tile_begin = (*tile_it).*tile_index;
+            const auto& first_overlap = tile_begin + 1 > search_length ? tile_begin + 1 - search_length : 0u;
+            const auto& last_begin = side.tokens.size() - search_length;
+            for (auto begin = first_overlap; begin < tile_begin + tile_it->match_length and begin <= last_begin; ++begin) {
+                const auto& bucket_it = cached.index.find(side.hashes->window(begin, search_length));
+                if (bucket_it == cached.index.end()) {
+                    continue;
+                }
+                auto& positions = bucket_it->second;
+                positions.erase(std::remove(positions.begin(), positions.end(), side.tokens.begin() + begin), positions.end());
+                if (positions.empty()) {
+                    cached.index.erase(bucket_it);
+                }
+            }
+        }
+        cached.tiles_seen = tiles.size();
+        return cached.index;
+    }
+};
+
+
 template<class T>
 inline T markarrays(Tokens& pattern_marks, Tokens& text_marks, Matches& matches, Tiles& tiles) noexcept {
 
@@ -173,12 +699,110 @@ inline T markarrays(Tokens& pattern_marks, Tokens& text_marks, Matches& matches,
 }
 
 
+/*
+ * State of the Greedy String Tiling loop over search lengths between iterations.
+ */
+class TilingLoop {
+public:
+    TilingLoop(const match_length_t& init_search_length, const match_length_t& pattern_unmarked_count, const match_length_t& text_unmarked_count) :
+        init_search_length(init_search_length),
+        search_length(init_search_length),
+        pattern_unmarked_count(pattern_unmarked_count),
+        text_unmarked_count(text_unmarked_count) {}
+
+    // Run one iteration of the loop, using scanner for finding matches and appending new tiles to tiles.
+    // Return false if the loop has terminated.
+    template<class Scanner>
+    bool step(Scanner& scanner, Tokens& pattern_marks, Tokens& text_marks, Tiles& tiles) noexcept {
+        // Search for all matches of maximal length and longer than search_length
+        if (finished()) {
+            terminated = true;
+            return false;
+        }
+
+        matches.clear();
+        // Find all matching substrings and their lengths, and push the data to matches.
+        // The scanner may raise search_length to the length of a very long match, and find the matches of a pass at that length
+        match_length_t maxmatch = scanner.scan(matches, search_length, pattern_unmarked_count, text_unmarked_count, tiles);
+
+        if (maxmatch > 2 * search_length) {
+            // The scanner stopped at a very long match,
+            // try again with larger search_length to avoid redundant matching of subset matches
+            search_length = maxmatch;
+            return true;
+        }
+
+        const auto prev_length_of_tokens_tiled = length_of_tokens_tiled;
+        PROFILING_PHASE(ProfilingPhase::tiles);
+        // Create new tiles by marking all unmarked tokens that participate in a maximal match
+        const auto& new_tokens_tiled = markarrays<match_length_t>(pattern_marks, text_marks, matches, tiles);
+        length_of_tokens_tiled += new_tokens_tiled;
+        // Every tile marks the same amount of tokens in both strings
+        pattern_unmarked_count -= new_tokens_tiled;
+        text_unmarked_count -= new_tokens_tiled;
+
+        // FIXME hack, terminate loop if the amount of tokens tiled stays the same for 10 iterations
+        if (length_of_tokens_tiled == prev_length_of_tokens_tiled && ++tiled_count_repeats > 10) {
+            terminated = true;
+            return false;
+        }
+
+        if (search_length > 2 * init_search_length) {
+            search_length >>= 1;
+        } else if (search_length > init_search_length) {
+            search_length = init_search_length;
+        } else if (search_length > 0) {
+            --search_length;
+        }
+        return true;
+    }
+
+    // True if the next call to step terminates the loop without scanning
+    bool finished() const noexcept {
+        return terminated or not (search_length > 0 and search_length >= init_search_length);
+    }
+
+    // Search length of the next scan
+    const match_length_t& next_search_length() const noexcept {
+        return search_length;
+    }
+
+private:
+    const match_length_t init_search_length;
+    match_length_t search_length;
+    match_length_t pattern_unmarked_count;
+    match_length_t text_unmarked_count;
+    match_length_t length_of_tokens_tiled = 0u;
+    // FIXME hack, for terminating loops on some pairs of input that cause infinite loops
+    unsigned tiled_count_repeats = 0;
+    bool terminated = false;
+    Matches matches;
+};
+
+
+/*
+ * Construct a token string with initial marks, assuming missing marks to be false.
+ * Return the amount of unmarked tokens, for choosing which string to index in scanpatterns.
+ */
+inline match_length_t make_tokens(const std::string& str, const std::string& init_marks, Tokens& tokens) noexcept {
+    match_length_t unmarked_count = 0u;
+    tokens.reserve(str.size());
+    for (auto i = 0u; i < str.size(); ++i) {
+        const auto& init_mark = (i < init_marks.size() and init_marks[i] == '1');
+        tokens.push_back({ str[i], init_mark });
+        unmarked_count += not init_mark;
+    }
+    return unmarked_count;
+}
+
+
 Tiles match_strings(
         const std::string& pattern,
         const std::string& text,
         const match_length_t& init_search_length,
         const std::string& init_pattern_marks,
-        const std::string& init_text_marks) noexcept {
+        const std::string& init_text_marks,
+        const HashingMode& hashing_mode) noexcept {
 
     Tiles tiles;
     if (pattern.size() < init_search_length || text.size() < init_search_length) {
@@ -186,63 +810,440 @@ Tiles match_strings(
         return tiles;
     }
 
-    // Construct token strings with initial marks, assuming missing marks to be false
-
+    PROFILING_PHASE(ProfilingPhase::tokens);
     Tokens pattern_marks;
-    pattern_marks.reserve(pattern.size());
-    for (auto i = 0u; i < pattern.size(); ++i) {
-        const auto& init_mark = (i < init_pattern_marks.size() and init_pattern_marks[i] == '1');
-        pattern_marks.push_back({ pattern[i], init_mark });
+    const auto& pattern_unmarked_count = make_tokens(pattern, init_pattern_marks, pattern_marks);
+    Tokens text_marks;
+    const auto& text_unmarked_count = make_tokens(text, init_text_marks, text_marks);
+
+    TilingLoop loop(init_search_length, pattern_unmarked_count, text_unmarked_count);
+    if (hashing_mode == HashingMode::prefix) {
+        // Prefix hashes are computed once, as part of the hash index
+        PROFILING_PHASE(ProfilingPhase::hash_index);
+        PrefixScanner scanner(pattern_marks, text_marks);
+        while (loop.step(scanner, pattern_marks, text_marks, tiles)) {}
+    } else {
+        RollingScanner scanner(pattern_marks, text_marks);
+        while (loop.step(scanner, pattern_marks, text_marks, tiles)) {}
     }
 
-    Tokens text_marks;
-    text_marks.reserve(text.size());
-    for (auto i = 0u; i < text.size(); ++i) {
-        const auto& init_mark = (i < init_text_marks.size() and init_text_marks[i] == '1');
-        text_marks.push_back({ text[i], init_mark });
+    return tiles;
+}
+
+
+/*
+ * Tokens, scanner and loop state of a TileStream.
+ * Scanners refer to the tokens, so the state is never moved.
+ */
+struct TileStream::State {
+    State(const std::string& pattern, const std::string& text, const match_length_t& init_search_length,
+            const std::string& init_pattern_marks, const std::string& init_text_marks, const HashingMode& hashing_mode) noexcept :
+        pattern_unmarked_count(make_tokens(pattern, init_pattern_marks, pattern_marks)),
+        text_unmarked_count(make_tokens(text, init_text_marks, text_marks)),
+        loop(init_search_length, pattern_unmarked_count, text_unmarked_count) {
+        if (pattern.size() < init_search_length || text.size() < init_search_length) {
+            // Too short threshold for creating matches
+            finished = true;
+        } else if (hashing_mode == HashingMode::prefix) {
+            prefix_scanner.reset(new PrefixScanner(pattern_marks, text_marks));
+        } else {
+            rolling_scanner.reset(new RollingScanner(pattern_marks, text_marks));
+        }
     }
 
-    match_length_t length_of_tokens_tiled = 0u;
-    match_length_t search_length = init_search_length;
+    bool step() noexcept {
+        if (prefix_scanner) {
+            return loop.step(*prefix_scanner, pattern_marks, text_marks, tiles);
+        }
+        return loop.step(*rolling_scanner, pattern_marks, text_marks, tiles);
+    }
 
-    // FIXME hack, for terminating loops on some pairs of input that cause infinite loops
-    match_length_t prev_length_of_tokens_tiled = 1u;
-    unsigned tiled_count_repeats = 0;
+    Tokens pattern_marks;
+    Tokens text_marks;
+    const match_length_t pattern_unmarked_count;
+    const match_length_t text_unmarked_count;
+    TilingLoop loop;
+    std::unique_ptr<RollingScanner> rolling_scanner;
+    std::unique_ptr<PrefixScanner> prefix_scanner;
+    // All tiles created so far, of which the scanners keep track
+    Tiles tiles;
+    bool finished = false;
+};
 
-    Matches matches;
 
-    // Search for all matches of maximal length and longer than search_length
-    while (search_length > 0 and search_length >= init_search_length) {
-        matches.clear();
-        // Find all matching substrings and their lengths, and push the data to matches
-        match_length_t maxmatch = scanpatterns(pattern_marks, text_marks, matches, search_length);
+TileStream::TileStream(
+        const std::string& pattern,
+        const std::string& text,
+        const match_length_t& init_search_length,
+        const std::string& init_pattern_marks,
+        const std::string& init_text_marks,
+        const HashingMode& hashing_mode) noexcept :
+    state(new State(pattern, text, init_search_length, init_pattern_marks, init_text_marks, hashing_mode)) {}
 
-        if (maxmatch > 2 * search_length) {
-            // Found a very long match,
-            // try again with larger search_length to avoid redundant matching of subset matches
-            search_length = maxmatch;
-            continue;
-        }
 
-        prev_length_of_tokens_tiled = length_of_tokens_tiled;
-        // Create new tiles by marking all unmarked tokens that participate in a maximal match
-        length_of_tokens_tiled += markarrays<match_length_t>(pattern_marks, text_marks, matches, tiles);
+TileStream::~TileStream() = default;
 
-        // FIXME hack, terminate loop if the amount of tokens tiled stays the same for 10 iterations
-        if (length_of_tokens_tiled == prev_length_of_tokens_tiled && ++tiled_count_repeats > 10) {
-            break;
-        }
 
-        if (search_length > 2 * init_search_length) {
-            search_length >>= 1;
-        } else if (search_length > init_search_length) {
-            search_length = init_search_length;
-        } else if (search_length > 0) {
-            --search_length;
+bool TileStream::next(Tiles& new_tiles) noexcept {
+    auto& tiles = state->tiles;
+    const auto first_new = tiles.size();
+    while (not state->finished and tiles.size() == first_new) {
+        state->finished = not state->step();
+    }
+    if (tiles.size() == first_new) {
+        return false;
+    }
+    // Tiles of one pass are created in the order their matches were found, emit them longest first
+    std::vector<std::size_t> order(tiles.size() - first_new);
+    for (auto i = 0u; i < order.size(); ++i) {
+        order[i] = first_new + i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&tiles](std::size_t a, std::size_t b) {
+        return tiles[a].match_length > tiles[b].match_length;
+    });
+    new_tiles.reserve(new_tiles.size() + order.size());
+    for (const auto& i : order) {
+        new_tiles.push_back(tiles[i]);
+    }
+    return true;
+}
+
+
+bool TileStream::finished() const noexcept {
+    return state->finished;
+}
+
+
+/*
+ * Tokens with initial marks and, for HashingMode::prefix, prefix hashes of a PreparedString.
+ * For HashingMode::rolling, the window fingerprints of one window length may be given.
+ */
+struct PreparedString::State {
+    State(const std::string& str, const std::string& init_marks, const HashingMode& hashing_mode) noexcept :
+        unmarked_count(make_tokens(str, init_marks, tokens)) {
+        if (hashing_mode == HashingMode::prefix) {
+            prefix_hashes = std::make_shared<const PrefixHashes>(tokens);
         }
     }
 
+    State(const std::string& str, const std::string& init_marks, WindowFingerprints fingerprints, const match_length_t& window_length) noexcept :
+        unmarked_count(make_tokens(str, init_marks, tokens)),
+        fingerprints(std::move(fingerprints)),
+        fingerprint_length(window_length) {}
+
+    Tokens tokens;
+    const match_length_t unmarked_count;
+    // Shared with the scanners of all pairs the string is matched in
+    std::shared_ptr<const PrefixHashes> prefix_hashes;
+    // Window fingerprints for search length fingerprint_length, none if it is 0
+    const WindowFingerprints fingerprints;
+    const match_length_t fingerprint_length = 0u;
+};
+
+
+PreparedString::PreparedString(
+        const std::string& str,
+        const std::string& init_marks,
+        const HashingMode& hashing_mode) noexcept :
+    state(new State(str, init_marks, hashing_mode)) {}
+
+
+PreparedString::PreparedString(
+        const std::string& str,
+        const std::string& init_marks,
+        WindowFingerprints fingerprints,
+        const match_length_t& window_length) noexcept :
+    state(new State(str, init_marks, std::move(fingerprints), window_length)) {}
+
+
+PreparedString::PreparedString(PreparedString&&) noexcept = default;
+
+
+PreparedString::~PreparedString() = default;
+
+
+std::size_t PreparedString::size() const noexcept {
+    return state->tokens.size();
+}
+
+
+std::size_t PreparedString::footprint() const noexcept {
+    const auto& token_bytes = state->tokens.size() * sizeof(Token);
+    // Prefixes and powers of each token
+    const auto& hash_bytes = state->prefix_hashes ? (state->tokens.size() + 1) * 2 * sizeof(std::uint64_t) : 0u;
+    const auto& fingerprint_bytes = state->fingerprints.size() * sizeof(WindowFingerprints::value_type);
+    return sizeof(State) + token_bytes + hash_bytes + fingerprint_bytes;
+}
+
+
+Tiles match_prepared(
+        const PreparedString& pattern,
+        const PreparedString& text,
+        const match_length_t& init_search_length) noexcept {
+
+    Tiles tiles;
+    const auto& prepared_pattern = *pattern.state;
+    const auto& prepared_text = *text.state;
+    if (prepared_pattern.tokens.size() < init_search_length || prepared_text.tokens.size() < init_search_length) {
+        // Too short threshold for creating matches
+        return tiles;
+    }
+
+    // Tiling marks the tokens, so every pair is matched on copies of the prepared tokens
+    PROFILING_PHASE(ProfilingPhase::tokens);
+    Tokens pattern_marks(prepared_pattern.tokens);
+    Tokens text_marks(prepared_text.tokens);
+
+    TilingLoop loop(init_search_length, prepared_pattern.unmarked_count, prepared_text.unmarked_count);
+    if (prepared_pattern.prefix_hashes and prepared_text.prefix_hashes) {
+        PrefixScanner scanner(pattern_marks, prepared_pattern.prefix_hashes, text_marks, prepared_text.prefix_hashes);
+        while (loop.step(scanner, pattern_marks, text_marks, tiles)) {}
+    } else if (prepared_pattern.fingerprint_length > 0 and prepared_pattern.fingerprint_length == prepared_text.fingerprint_length) {
+        RollingScanner scanner(pattern_marks, &prepared_pattern.fingerprints, text_marks, &prepared_text.fingerprints, prepared_pattern.fingerprint_length);
+        while (loop.step(scanner, pattern_marks, text_marks, tiles)) {}
+    } else {
+        RollingScanner scanner(pattern_marks, text_marks);
+        while (loop.step(scanner, pattern_marks, text_marks, tiles)) {}
+    }
+
     return tiles;
 }
 
 
+/*
+ * Scanner that hands over the matches of a pass that have already been found, e.g. by match_one_to_many.
+ */
+class FoundMatchesScanner {
+public:
+    FoundMatchesScanner(Matches& found, const match_length_t& maxmatch) :
+        found(found),
+        maxmatch(maxmatch) {}
+
+    inline match_length_t scan(Matches& matches, const match_length_t&, const match_length_t&, const match_length_t&, const Tiles&) noexcept {
+        matches.swap(found);
+        return maxmatch;
+    }
+
+private:
+    Matches& found;
+    const match_length_t maxmatch;
+};
+
+
+/*
+ * Matching substrings of the query and a text of match_one_to_many, found at the start of a pass.
+ */
+struct WindowHit {
+    std::size_t query_index;
+    std::size_t text_index;
+    match_length_t match_length;
+};
+
+
+/*
+ * Tokens, loop state and tiles of the query and one text of match_one_to_many.
+ * Matches refer to the tokens, so pairs are never moved.
+ */
+struct OneToManyPair {
+    OneToManyPair(const std::string& query, const std::string& init_query_marks, const std::string& text, const std::string& init_text_marks,
+            const match_length_t& init_search_length, const bool& query_is_pattern) noexcept :
+        query_unmarked_count(make_tokens(query, init_query_marks, query_marks)),
+        text_unmarked_count(make_tokens(text, init_text_marks, text_marks)),
+        query_is_pattern(query_is_pattern),
+        loop(init_search_length,
+             query_is_pattern ? query_unmarked_count : text_unmarked_count,
+             query_is_pattern ? text_unmarked_count : query_unmarked_count) {}
+
+    // Orient hits as the scanners of match_strings do, and run the rest of the current iteration of the loop
+    void step() noexcept {
+        Matches found;
+        match_length_t maxmatch = 0;
+        if (has_long_hit) {
+            // The pass ends at the long match, which restarts the loop with its length
+            maxmatch = long_hit.match_length;
+        } else {
+            if (query_is_pattern) {
+                // Hits are found in the order of the text windows, but match_strings records matches in the order of the pattern
+                std::sort(hits.begin(), hits.end(), [](const WindowHit& a, const WindowHit& b) {
+                    return std::tie(a.query_index, a.text_index) < std::tie(b.query_index, b.text_index);
+                });
+            }
+            found.reserve(hits.size());
+            for (const auto& hit : hits) {
+                const auto& query_it = query_marks.begin() + hit.query_index;
+                const auto& text_it = text_marks.begin() + hit.text_index;
+                found.push_back({ query_is_pattern ? query_it : text_it, query_is_pattern ? text_it : query_it, hit.match_length });
+                maxmatch = std::max(maxmatch, hit.match_length);
+            }
+        }
+        FoundMatchesScanner scanner(found, maxmatch);
+        if (query_is_pattern) {
+            loop.step(scanner, query_marks, text_marks, tiles);
+        } else {
+            loop.step(scanner, text_marks, query_marks, tiles);
+        }
+    }
+
+    Tokens query_marks;
+    Tokens text_marks;
+    const match_length_t query_unmarked_count;
+    const match_length_t text_unmarked_count;
+    const bool query_is_pattern;
+    TilingLoop loop;
+    Tiles tiles;
+    // Window fingerprints of the text for the initial search length
+    WindowFingerprints text_fingerprints;
+
+    // State of the current pass
+    std::vector<WindowHit> hits;
+    // The first match longer than 2 * search_length in the order of the pattern, which ends the pass in match_strings
+    bool has_long_hit = false;
+    WindowHit long_hit = { 0u, 0u, 0u };
+};
+
+
+/*
+ * Find the matches of one pass for all given pairs that are at the same search length.
+ * Every pair gets the same matches as stream_windows would find, but possibly in a different order, see OneToManyPair::step.
+ * The windows of the text of a pair are hashed with text_hasher_of(pair).
+ */
+template<class QueryHasher, class TextHasherOf>
+static void find_window_hits(Tokens& query_tokens, QueryHasher& query_hasher, std::vector<std::unique_ptr<OneToManyPair> >& pairs,
+        const std::vector<std::size_t>& pair_indexes, const match_length_t& search_length, TextHasherOf&& text_hasher_of) noexcept {
+    // Index every window of the query once, the query marks of a pair are checked only for the windows found in its text
+    PROFILING_PHASE(ProfilingPhase::hash_index);
+    WindowIndex<match_length_t> query_index;
+    for (auto it = query_tokens.begin(); it + search_length <= query_tokens.end(); ++it) {
+        query_index[(it == query_tokens.begin()) ? query_hasher.first(it) : query_hasher.next(it)].push_back(it);
+    }
+
+    // Stream the unmarked windows of every text through the query index
+    PROFILING_PHASE(ProfilingPhase::matches);
+    for (const auto& i : pair_indexes) {
+        auto& pair = *pairs[i];
+        auto&& text_hasher = text_hasher_of(pair);
+        pair.hits.clear();
+        pair.has_long_hit = false;
+        for_each_unmarked_window(pair.text_marks, search_length, text_hasher, [&](typename Tokens::iterator text_it, const match_length_t& hash) {
+            const auto& bucket_it = query_index.find(hash);
+            if (bucket_it == query_index.end()) {
+                return true;
+            }
+            const std::size_t text_index = text_it - pair.text_marks.begin();
+            for (const auto& query_window_it : bucket_it->second) {
+                const std::size_t query_index = query_window_it - query_tokens.begin();
+                // Matches after the long match in the order of the pattern are never used
+                if (pair.has_long_hit and std::tie(query_index, text_index) > std::tie(pair.long_hit.query_index, pair.long_hit.text_index)) {
+                    continue;
+                }
+                const auto& query_it = pair.query_marks.begin() + query_index;
+                if (not std::all_of(query_it, query_it + search_length, is_unmarked)) {
+                    continue;
+                }
+                // Count the matching characters after the window, as in stream_windows
+                auto query_jt = query_it + search_length;
+                auto text_jt = text_it + search_length;
+                match_length_t matching_chars = search_length;
+                while (query_jt != pair.query_marks.end() and text_jt != pair.text_marks.end() and is_a_match(*query_jt, *text_jt)) {
+                    ++matching_chars;
+                    ++query_jt;
+                    ++text_jt;
+                }
+                if (matching_chars > 2 * search_length) {
+                    pair.has_long_hit = true;
+                    pair.long_hit = { query_index, text_index, matching_chars };
+                    // Windows are found in the order of the pattern when the text is the pattern, so this long match ends the pass
+                    if (not pair.query_is_pattern) {
+                        return false;
+                    }
+                } else {
+                    pair.hits.push_back({ query_index, text_index, matching_chars });
+                }
+            }
+            return true;
+        });
+    }
+}
+
+
+std::vector<Tiles> match_one_to_many(
+        const std::string& query,
+        const std::vector<std::pair<std::string, std::string> >& texts,
+        const match_length_t& init_search_length,
+        const std::string& init_query_marks,
+        const bool& shorter_as_pattern) noexcept {
+
+    std::vector<std::unique_ptr<OneToManyPair> > pairs(texts.size());
+    std::vector<std::size_t> active;
+    PROFILING_PHASE(ProfilingPhase::tokens);
+    for (auto i = 0u; i < texts.size(); ++i) {
+        const auto& text = texts[i];
+        // Too short threshold for creating matches
+        if (query.size() < init_search_length || text.first.size() < init_search_length) {
+            continue;
+        }
+        const bool query_is_pattern = not (shorter_as_pattern and text.first.size() < query.size());
+        pairs[i].reset(new OneToManyPair(query, init_query_marks, text.first, text.second, init_search_length, query_is_pattern));
+        if (not pairs[i]->loop.finished()) {
+            active.push_back(i);
+        }
+    }
+    // Characters of the query for hashing its windows, the marks are checked separately for each pair
+    Tokens query_tokens;
+    make_tokens(query, "", query_tokens);
+
+    // Passes at the initial search length look up the windows of all strings from fingerprints computed in one batch
+    PROFILING_PHASE(ProfilingPhase::hash_index);
+    const auto& query_fingerprints = window_fingerprints(query, init_search_length);
+    auto text_fingerprints = batch_window_fingerprints(texts, init_search_length);
+    for (auto i = 0u; i < texts.size(); ++i) {
+        if (pairs[i]) {
+            pairs[i]->text_fingerprints = std::move(text_fingerprints[i]);
+        }
+    }
+
+    while (not active.empty()) {
+        // Pairs at the same search length share a pass over the query
+        std::map<match_length_t, std::vector<std::size_t> > pairs_by_length;
+        for (const auto& i : active) {
+            pairs_by_length[pairs[i]->loop.next_search_length()].push_back(i);
+        }
+        for (const auto& length_pairs : pairs_by_length) {
+            const auto& search_length = length_pairs.first;
+            if (search_length == init_search_length) {
+                FingerprintWindowHasher query_hasher(query_fingerprints, query_tokens.begin());
+                find_window_hits(query_tokens, query_hasher, pairs, length_pairs.second, search_length, [](OneToManyPair& pair) {
+                    return FingerprintWindowHasher(pair.text_fingerprints, pair.text_marks.begin());
+                });
+            } else {
+                RollingWindowHasher<match_length_t> query_hasher(search_length);
+                RollingWindowHasher<match_length_t> text_hasher(search_length);
+                find_window_hits(query_tokens, query_hasher, pairs, length_pairs.second, search_length, [&text_hasher](OneToManyPair&) -> RollingWindowHasher<match_length_t>& {
+                    return text_hasher;
+                });
+            }
+        }
+        PROFILING_PHASE(ProfilingPhase::tiles);
+        active.erase(std::remove_if(active.begin(), active.end(), [&pairs](const std::size_t& i) {
+            auto& pair = *pairs[i];
+            pair.step();
+            return pair.loop.finished();
+        }), active.end());
+    }
+
+    std::vector<Tiles> all_tiles(texts.size());
+    for (auto i = 0u; i < texts.size(); ++i) {
+        if (not pairs[i]) {
+            continue;
+        }
+        if (pairs[i]->query_is_pattern) {
+            all_tiles[i] = std::move(pairs[i]->tiles);
+            continue;
+        }
+        all_tiles[i].reserve(pairs[i]->tiles.size());
+        for (const auto& tile : pairs[i]->tiles) {
+            all_tiles[i].push_back({ tile.text_index, tile.pattern_index, tile.match_length });
+        }
+    }
+    return all_tiles;
+}
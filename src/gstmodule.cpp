@@ -1,4 +1,17 @@
 #include "gst.hpp"
+#include "sketch.hpp"
+#include "duplicates.hpp"
+#include "tileset.hpp"
+#include "worker_pool.hpp"
+#include "result_cache.hpp"
+#include "all_pairs.hpp"
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <system_error>
 // Enforce internal, signed size-type over unsigned size_t
 // https://www.python.org/dev/peps/pep-0353
 #define PY_SSIZE_T_CLEAN
@@ -6,59 +19,79 @@
 
 #define GSTMODULE_DOCSTRING "This module implements a pattern matching function for str and bytes objects."
 
-#define GST_MATCH_DOCSTRING "Takes 5 arguments: pattern (ascii str/bytes), pattern_marks (ascii (1 or 0) str/bytes), text (ascii str/bytes), text_marks (ascii (1 or 0) str/bytes), minimum_match_length (uint)"
+#define GST_GROUP_DUPLICATES_DOCSTRING "Takes 1 or 2 arguments: documents (sequence of (tokens, marks) pairs of ascii str/bytes), ignore_marked (bool, default False). Returns a list of classes of duplicate documents, each a list of indexes with the representative first. Documents are duplicates if their tokens and marks are equal, or if ignore_marked is true, if they differ only in their marked tokens"
 
-static PyObject* MatchError;
+#define GST_SKETCH_CANDIDATES_DOCSTRING "Takes 3 to 5 arguments: documents (sequence of (tokens, marks) pairs of ascii str/bytes), kgram_length (uint), threshold (float), bands (uint, default 32), rows (uint, default 4). Returns a list of 3-tuples (index_a, index_b, estimated_jaccard) for all document pairs with index_a < index_b that are likely to have an estimated Jaccard similarity of at least threshold"
 
-/*
- * Corresponding Python function definition
- * def gst.match(pattern: str/bytes, pattern_marks: str/bytes, text: str/bytes, text_marks: str/bytes, minimum_match_length: uint):
- *     #stuff
- *     return [(pattern_begin, text_begin, match_length) for ... in matches]
- */
-static PyObject*
-gst_match(PyObject* self, PyObject* args)
-{
-    const char* pattern_c_str;
-    Py_ssize_t pattern_length;
+#define GST_MATCH_ONE_TO_MANY_DOCSTRING "Takes 4 or 5 arguments: query (ascii str/bytes), query_marks (ascii (1 or 0) str/bytes), documents (sequence of (tokens, marks) pairs of ascii str/bytes), minimum_match_length (uint), shorter_as_pattern (bool, default False). Returns a list with the return value of match(query, query_marks, tokens, marks, minimum_match_length) for each document, computed by hashing the query once for all documents. If shorter_as_pattern is true, documents shorter than the query are matched as the pattern, and their tiles list the query indexes first"
 
-    const char* pattern_marks;
-    Py_ssize_t pattern_marks_length;
+#define GST_MATCH_ALL_PAIRS_DOCSTRING "Takes 2 to 6 arguments: documents (sequence of (tokens, marks) pairs of ascii str/bytes), minimum_match_length (uint), block_size (uint, default 131072), cache (ResultCache or None, default None), minimum_similarity (float or None, default None), weights (sequence of uint or None, default None). Returns a list of 3-tuples (index_a, index_b, tiles) for all document pairs with index_a < index_b in ascending order, where tiles are the return value of match for the shorter document of the pair as the pattern, with the indexes into document a first. The pairs are matched in blocks of documents of about block_size bytes of prepared tokens, so that both blocks stay in the CPU cache, 0 for matching row by row. If a cache is given, results are read from and stored to it. If minimum_similarity is given, only the pairs whose amount of tiled tokens divided by the mean of the weights of both documents is greater than minimum_similarity are returned, and the weights default to the amount of unmarked tokens of each document"
 
-    const char* text_c_str;
-    Py_ssize_t text_length;
+#define GST_MATCH_ALL_PAIRS_ITER_DOCSTRING "Takes the same arguments as match_all_pairs. Returns an iterator over the same 3-tuples, which matches the pairs of the next block of documents index_a when the pairs of the previous block have been consumed, so that only the pairs of one block are held at a time"
 
-    const char* text_marks;
-    Py_ssize_t text_marks_length;
+#define GST_MATCH_ASYNC_DOCSTRING "Takes the same 5 arguments as match. Returns an asyncio future of the running event loop, which completes with the return value of match once a native worker pool has computed it without holding the GIL. Cancelling the future skips the computation if it has not yet started"
 
-    unsigned long minimum_match_length;
+#define GST_SET_POOL_SIZE_DOCSTRING "Takes 1 argument: size (uint). Sets the amount of worker threads used by match_async, 0 for the amount of hardware threads (default). Jobs already submitted are completed before the current pool is replaced"
 
-    if (!PyArg_ParseTuple(args, "s#s#s#s#k",
-            &pattern_c_str, &pattern_length,
-            &pattern_marks, &pattern_marks_length,
-            &text_c_str, &text_length,
-            &text_marks, &text_marks_length,
-            &minimum_match_length)) {
-        PyErr_SetString(MatchError, "Invalid arguments, please see docstring");
-        return (PyObject*)NULL;
-    }
+#define GST_MATCH_ITER_DOCSTRING "Takes the same 5 arguments as match. Returns an iterator over the same tiles as match, which runs the matching lazily: each time the tiles of a pass are exhausted, the next pass is run, and its tiles are yielded longest first. No matching is done after iteration stops"
 
-    // It is impossible to find a match in a text that is shorter than the minimum match length
-    if (text_length < (Py_ssize_t)minimum_match_length) {
-        return PyList_New(0); // Return an empty list
-    }
+#define GST_MATCH_DOCSTRING "Takes 5 arguments, positional or by keyword: pattern (ascii str/bytes), pattern_marks (ascii (1 or 0) str/bytes), text (ascii str/bytes), text_marks (ascii (1 or 0) str/bytes), minimum_match_length (uint)"
 
-    // TODO: replace with c++17 string_view to avoid copying the const char*
-    const std::string pattern(pattern_c_str, pattern_length);
-    const std::string text(text_c_str, text_length);
+// Serialize access to an object, e.g. a TileSet or a list, in free-threaded builds, where method calls are not serialized by the GIL
+#if PY_VERSION_HEX >= 0x030D0000
+#define GST_BEGIN_CRITICAL_SECTION(op) Py_BEGIN_CRITICAL_SECTION(op)
+#define GST_BEGIN_CRITICAL_SECTION2(a, b) Py_BEGIN_CRITICAL_SECTION2(a, b)
+#define GST_END_CRITICAL_SECTION() Py_END_CRITICAL_SECTION()
+#define GST_END_CRITICAL_SECTION2() Py_END_CRITICAL_SECTION2()
+#else
+#define GST_BEGIN_CRITICAL_SECTION(op) {
+#define GST_BEGIN_CRITICAL_SECTION2(a, b) {
+#define GST_END_CRITICAL_SECTION() }
+#define GST_END_CRITICAL_SECTION2() }
+#endif
+
+/*
+ * Worker pool of gst.match_async, created on first use with size threads.
+ * The mutex guards both members, since match_async and set_pool_size may be called concurrently without a GIL.
+ */
+struct PoolState {
+    std::mutex mutex;
+    std::unique_ptr<WorkerPool> pool;
+    Py_ssize_t size = 0;
+};
 
-    const std::string pattern_marks_str(pattern_marks, pattern_marks_length);
-    const std::string text_marks_str(text_marks, text_marks_length);
+/*
+ * State of one gst module object.
+ * Each (sub-)interpreter importing gst has its own exception and type objects and worker pool.
+ */
+typedef struct {
+    PyObject* MatchError;
+    PyTypeObject* TileSetType;
+    PyTypeObject* TileIteratorType;
+    PyTypeObject* AllPairsIteratorType;
+    PyTypeObject* ResultCacheType;
+    // asyncio.get_running_loop
+    PyObject* get_running_loop;
+    // Callables completing a future with a value unless it is already done (cancelled), called in the event loop thread
+    PyObject* future_set_result;
+    PyObject* future_set_exception;
+    PoolState* pool_state;
+} ModuleState;
 
-    const auto& matches = match_strings(pattern, text, minimum_match_length, pattern_marks_str, text_marks_str);
+static inline ModuleState*
+get_module_state(PyObject* module)
+{
+    return (ModuleState*)PyModule_GetState(module);
+}
 
-    // Build a list of 3-tuples from matches and return it
 
+/*
+ * Build a list of 3-tuples (pattern_begin, text_begin, match_length) from tiles.
+ * Return NULL with an exception set on failure.
+ */
+static PyObject*
+tiles_to_list(const Tiles& matches)
+{
     PyObject* py_list_matches;
     Py_ssize_t py_matches_len = (Py_ssize_t)matches.size();
     // Note that on successful creation, py_list_matches owns one reference to the new list
@@ -87,35 +120,1676 @@ gst_match(PyObject* self, PyObject* args)
 }
 
 
-// Define the Python module
+/*
+ * Arguments of match and match_async.
+ * The strings are borrowed from the argument objects and valid for the duration of the call.
+ */
+struct MatchArguments {
+    const char* pattern;
+    Py_ssize_t pattern_length;
+    const char* pattern_marks;
+    Py_ssize_t pattern_marks_length;
+    const char* text;
+    Py_ssize_t text_length;
+    const char* text_marks;
+    Py_ssize_t text_marks_length;
+    unsigned long minimum_match_length;
+};
 
-static PyMethodDef module_methods[] = {
-    {"match", gst_match, METH_VARARGS, GST_MATCH_DOCSTRING},
-    {NULL, NULL, 0, NULL} // Sentinel
+static const char* const match_keywords[] = {"pattern", "pattern_marks", "text", "text_marks", "minimum_match_length"};
+static const Py_ssize_t match_keywords_count = sizeof(match_keywords) / sizeof(match_keywords[0]);
+
+/*
+ * Borrow the contents of a str (as UTF-8) or read-only bytes-like object, as the "s#" format of PyArg_ParseTuple.
+ * Return false with an exception set if the object is neither.
+ */
+static bool
+as_string(PyObject* py_string, const char** c_str, Py_ssize_t* length)
+{
+    return PyArg_Parse(py_string, "s#", c_str, length);
+}
+
+/*
+ * Parse the vectorcall arguments of match and match_async, given positionally or by keyword.
+ * Return false with MatchError set if the arguments are invalid.
+ */
+static bool
+parse_match_arguments(ModuleState* state, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames, MatchArguments& parsed)
+{
+    PyObject* values[match_keywords_count] = {NULL};
+    bool valid = nargs <= match_keywords_count;
+    for (Py_ssize_t i = 0; valid and i < nargs; ++i) {
+        values[i] = args[i];
+    }
+    const Py_ssize_t kwargs_count = kwnames == (PyObject*)NULL ? 0 : PyTuple_GET_SIZE(kwnames);
+    for (Py_ssize_t k = 0; valid and k < kwargs_count; ++k) {
+        PyObject* kwname = PyTuple_GET_ITEM(kwnames, k);
+        Py_ssize_t i = 0;
+        while (i < match_keywords_count and PyUnicode_CompareWithASCIIString(kwname, match_keywords[i]) != 0) {
+            ++i;
+        }
+        // Unknown keyword or argument given both positionally and by keyword
+        valid = i < match_keywords_count and values[i] == (PyObject*)NULL;
+        if (valid) {
+            values[i] = args[nargs + k];
+        }
+    }
+    for (Py_ssize_t i = 0; valid and i < match_keywords_count; ++i) {
+        valid = values[i] != (PyObject*)NULL;
+    }
+    valid = valid
+        and as_string(values[0], &parsed.pattern, &parsed.pattern_length)
+        and as_string(values[1], &parsed.pattern_marks, &parsed.pattern_marks_length)
+        and as_string(values[2], &parsed.text, &parsed.text_length)
+        and as_string(values[3], &parsed.text_marks, &parsed.text_marks_length)
+        // As the "k" format, negative lengths wrap around and match nothing
+        and PyArg_Parse(values[4], "k", &parsed.minimum_match_length);
+    if (!valid) {
+        PyErr_Clear();
+        PyErr_SetString(state->MatchError, "Invalid arguments, please see docstring");
+    }
+    return valid;
+}
+
+
+/*
+ * Corresponding Python function definition
+ * def gst.match(pattern: str/bytes, pattern_marks: str/bytes, text: str/bytes, text_marks: str/bytes, minimum_match_length: uint):
+ *     #stuff
+ *     return [(pattern_begin, text_begin, match_length) for ... in matches]
+ */
+static PyObject*
+gst_match(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+    MatchArguments parsed;
+    if (!parse_match_arguments(get_module_state(self), args, nargs, kwnames, parsed)) {
+        return (PyObject*)NULL;
+    }
+
+    // It is impossible to find a match in a text that is shorter than the minimum match length
+    if (parsed.text_length < (Py_ssize_t)parsed.minimum_match_length) {
+        return PyList_New(0); // Return an empty list
+    }
+
+    // TODO: replace with c++17 string_view to avoid copying the const char*
+    const std::string pattern(parsed.pattern, parsed.pattern_length);
+    const std::string text(parsed.text, parsed.text_length);
+
+    const std::string pattern_marks_str(parsed.pattern_marks, parsed.pattern_marks_length);
+    const std::string text_marks_str(parsed.text_marks, parsed.text_marks_length);
+
+    // Let other threads run while matching
+    Tiles matches;
+    Py_BEGIN_ALLOW_THREADS
+    matches = match_strings(pattern, text, parsed.minimum_match_length, pattern_marks_str, text_marks_str);
+    Py_END_ALLOW_THREADS
+
+    return tiles_to_list(matches);
+}
+
+
+// Define the TileIterator type
+
+#define GST_TILE_ITERATOR_DOCSTRING "Iterator over the tiles of two strings, created by match_iter"
+
+/*
+ * Resumable matching of a TileIterator.
+ * The mutex is held while advancing the stream, which is done without holding the GIL.
+ */
+struct TileIteration {
+    TileIteration(const std::string& pattern, const std::string& text, const match_length_t& init_search_length,
+            const std::string& init_pattern_marks, const std::string& init_text_marks) :
+        stream(pattern, text, init_search_length, init_pattern_marks, init_text_marks) {}
+
+    TileStream stream;
+    // Tiles of the latest pass, of which the first pass_index have been yielded
+    Tiles pass_tiles;
+    std::size_t pass_index = 0;
+    std::mutex mutex;
 };
 
-static struct PyModuleDef module_definition = {
-    PyModuleDef_HEAD_INIT,      // Boilerplate
-    "gst",                      // Module name, as in e.g. 'python3 -c "import gst"'
-    GSTMODULE_DOCSTRING,
-    -1,                         // Module has no support for sub-interpreters due to global state
-    module_methods              // Module method table
+typedef struct {
+    PyObject_HEAD
+    TileIteration* iteration;
+} TileIteratorObject;
+
+static void
+tile_iterator_dealloc(TileIteratorObject* self)
+{
+    // Instances of heap types own a reference to their type
+    PyTypeObject* type = Py_TYPE(self);
+    delete self->iteration;
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyObject*
+tile_iterator_next(TileIteratorObject* self)
+{
+    TileIteration* iteration = self->iteration;
+    if (!iteration->mutex.try_lock()) {
+        // Another thread is advancing the stream, wait for it without blocking threads that need the GIL
+        Py_BEGIN_ALLOW_THREADS
+        iteration->mutex.lock();
+        Py_END_ALLOW_THREADS
+    }
+    if (iteration->pass_index == iteration->pass_tiles.size()) {
+        iteration->pass_tiles.clear();
+        iteration->pass_index = 0;
+        Py_BEGIN_ALLOW_THREADS
+        iteration->stream.next(iteration->pass_tiles);
+        Py_END_ALLOW_THREADS
+    }
+    PyObject* py_tuple_tile = (PyObject*)NULL;
+    if (iteration->pass_index < iteration->pass_tiles.size()) {
+        const auto& tile = iteration->pass_tiles[iteration->pass_index++];
+        py_tuple_tile = Py_BuildValue("(kkk)", tile.pattern_index, tile.text_index, tile.match_length);
+    }
+    iteration->mutex.unlock();
+    // Returning NULL without an exception stops the iteration
+    return py_tuple_tile;
+}
+
+static PyType_Slot tile_iterator_slots[] = {
+    {Py_tp_doc, (void*)GST_TILE_ITERATOR_DOCSTRING},
+    {Py_tp_dealloc, (void*)tile_iterator_dealloc},
+    {Py_tp_iter, (void*)PyObject_SelfIter},
+    {Py_tp_iternext, (void*)tile_iterator_next},
+    {0, NULL} // Sentinel
 };
 
-PyMODINIT_FUNC
-PyInit_gst(void)
+static PyType_Spec tile_iterator_spec = {
+    "gst.TileIterator",             // name
+    sizeof(TileIteratorObject),     // basicsize
+    0,                              // itemsize
+#ifdef Py_TPFLAGS_DISALLOW_INSTANTIATION
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+#else
+    Py_TPFLAGS_DEFAULT,
+#endif
+    tile_iterator_slots
+};
+
+/*
+ * Corresponding Python function definition
+ * def gst.match_iter(pattern: str/bytes, pattern_marks: str/bytes, text: str/bytes, text_marks: str/bytes, minimum_match_length: uint):
+ *     #stuff
+ *     for ... in passes:
+ *         yield from sorted(pass_tiles, key=match_length, reverse=True)
+ */
+static PyObject*
+gst_match_iter(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
 {
-    PyObject* module;
-    module = PyModule_Create(&module_definition);
-    if (module == NULL)
-        return NULL;
+    ModuleState* state = get_module_state(self);
+    MatchArguments parsed;
+    if (!parse_match_arguments(state, args, nargs, kwnames, parsed)) {
+        return (PyObject*)NULL;
+    }
+
+    const std::string pattern(parsed.pattern, parsed.pattern_length);
+    const std::string text(parsed.text, parsed.text_length);
+    const std::string pattern_marks_str(parsed.pattern_marks, parsed.pattern_marks_length);
+    const std::string text_marks_str(parsed.text_marks, parsed.text_marks_length);
+
+    TileIteration* iteration;
+    // Tokenizing and hashing may take a while for long strings
+    Py_BEGIN_ALLOW_THREADS
+    iteration = new (std::nothrow) TileIteration(pattern, text, parsed.minimum_match_length, pattern_marks_str, text_marks_str);
+    Py_END_ALLOW_THREADS
+    if (iteration == (TileIteration*)NULL) {
+        return PyErr_NoMemory();
+    }
+
+    PyTypeObject* type = state->TileIteratorType;
+    TileIteratorObject* iterator = (TileIteratorObject*)type->tp_alloc(type, 0);
+    if (iterator == (TileIteratorObject*)NULL) {
+        delete iteration;
+        return (PyObject*)NULL;
+    }
+    iterator->iteration = iteration;
+    return (PyObject*)iterator;
+}
+
+
+// Asynchronous matching on a native worker pool
+
+/*
+ * Call the method of a future named by method_name with a value unless the future is already done.
+ * Bound to "set_result" or "set_exception" and scheduled with loop.call_soon_threadsafe(callable, future, value).
+ */
+static PyObject*
+gst_complete_future(PyObject* method_name, PyObject* args)
+{
+    PyObject* future;
+    PyObject* value;
+    if (!PyArg_UnpackTuple(args, "complete_future", 2, 2, &future, &value)) {
+        return (PyObject*)NULL;
+    }
+    PyObject* py_done = PyObject_CallMethod(future, "done", NULL);
+    if (py_done == (PyObject*)NULL) {
+        return (PyObject*)NULL;
+    }
+    const int done = PyObject_IsTrue(py_done);
+    Py_DECREF(py_done);
+    if (done < 0) {
+        return (PyObject*)NULL;
+    }
+    if (done) {
+        Py_RETURN_NONE;
+    }
+    return PyObject_CallMethodObjArgs(future, method_name, value, NULL);
+}
+
+static PyMethodDef complete_future_definition = {"complete_future", gst_complete_future, METH_VARARGS, NULL};
+
+typedef std::atomic<bool> CancelFlag;
+
+static void
+cancel_flag_destructor(PyObject* capsule)
+{
+    delete (std::shared_ptr<CancelFlag>*)PyCapsule_GetPointer(capsule, "gst.CancelFlag");
+}
+
+/*
+ * Done callback of a future returned by gst.match_async, bound to a capsule containing the cancel flag of the job.
+ * Sets the flag if the future was cancelled, so that a job that has not yet started is skipped.
+ */
+static PyObject*
+gst_on_future_done(PyObject* capsule, PyObject* future)
+{
+    PyObject* py_cancelled = PyObject_CallMethod(future, "cancelled", NULL);
+    if (py_cancelled == (PyObject*)NULL) {
+        return (PyObject*)NULL;
+    }
+    const int cancelled = PyObject_IsTrue(py_cancelled);
+    Py_DECREF(py_cancelled);
+    if (cancelled < 0) {
+        return (PyObject*)NULL;
+    }
+    if (cancelled) {
+        auto flag = (std::shared_ptr<CancelFlag>*)PyCapsule_GetPointer(capsule, "gst.CancelFlag");
+        if (flag == NULL) {
+            return (PyObject*)NULL;
+        }
+        (*flag)->store(true);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef on_future_done_definition = {"on_future_done", gst_on_future_done, METH_O, NULL};
+
+/*
+ * Inputs of one gst.match_async call and the owned references to its event loop, future and the callables completing the future.
+ * The references are released by the worker pool task while attached to the interpreter.
+ * The job does not own a reference to the module, since releasing the last one on a worker would free the module and its pool there.
+ */
+struct MatchJob {
+    std::string pattern;
+    std::string pattern_marks;
+    std::string text;
+    std::string text_marks;
+    unsigned long minimum_match_length;
+    std::shared_ptr<CancelFlag> cancelled;
+    PyInterpreterState* interpreter;
+    PyObject* set_result;
+    PyObject* set_exception;
+    PyObject* loop;
+    PyObject* future;
+};
+
+/*
+ * Worker pool task of a MatchJob.
+ * Matching runs detached from the interpreter, which a worker attaches to only to pass the result to the event loop.
+ * If the pool shut down before the job could run, the task is called by a thread already attached to the interpreter,
+ * and the future is cancelled.
+ */
+static void
+run_match_job(const std::shared_ptr<MatchJob>& job, bool dropped)
+{
+    const bool skip = dropped or job->cancelled->load();
+    Tiles matches;
+    if (!skip and job->text.size() >= job->minimum_match_length) {
+        matches = match_strings(job->pattern, job->text, job->minimum_match_length, job->pattern_marks, job->text_marks);
+    }
+
+    PyThreadState* thread_state = (PyThreadState*)NULL;
+    if (!dropped) {
+        thread_state = PyThreadState_New(job->interpreter);
+        PyEval_RestoreThread(thread_state);
+    }
+    PyObject* py_scheduled = (PyObject*)NULL;
+    if (dropped) {
+        PyObject* py_cancel = PyObject_GetAttrString(job->future, "cancel");
+        if (py_cancel != (PyObject*)NULL) {
+            py_scheduled = PyObject_CallMethod(job->loop, "call_soon_threadsafe", "O", py_cancel);
+            Py_DECREF(py_cancel);
+        }
+    } else if (!skip) {
+        PyObject* py_list_matches = tiles_to_list(matches);
+        if (py_list_matches != (PyObject*)NULL) {
+            py_scheduled = PyObject_CallMethod(job->loop, "call_soon_threadsafe", "OOO", job->set_result, job->future, py_list_matches);
+            Py_DECREF(py_list_matches);
+        } else {
+            PyObject *type, *value, *traceback;
+            PyErr_Fetch(&type, &value, &traceback);
+            PyErr_NormalizeException(&type, &value, &traceback);
+            py_scheduled = PyObject_CallMethod(job->loop, "call_soon_threadsafe", "OOO", job->set_exception, job->future, value);
+            Py_XDECREF(type);
+            Py_XDECREF(value);
+            Py_XDECREF(traceback);
+        }
+    }
+    if (py_scheduled == (PyObject*)NULL) {
+        // Nothing to do if the loop was closed before the job finished
+        PyErr_Clear();
+    }
+    Py_XDECREF(py_scheduled);
+    Py_DECREF(job->future);
+    Py_DECREF(job->loop);
+    Py_DECREF(job->set_exception);
+    Py_DECREF(job->set_result);
+    if (thread_state != (PyThreadState*)NULL) {
+        PyThreadState_Clear(thread_state);
+        PyThreadState_DeleteCurrent();
+    }
+}
+
+/*
+ * Detach the worker pool from the module state and wait for its workers while detached from the interpreter.
+ * Pending jobs are either run or their futures are cancelled.
+ */
+static void
+stop_worker_pool(PoolState* pool_state, bool run_pending)
+{
+    std::unique_ptr<WorkerPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(pool_state->mutex);
+        pool.swap(pool_state->pool);
+    }
+    if (!pool) {
+        return;
+    }
+    std::vector<WorkerPool::Task> dropped_tasks;
+    Py_BEGIN_ALLOW_THREADS
+    dropped_tasks = pool->shutdown(run_pending);
+    pool.reset();
+    Py_END_ALLOW_THREADS
+    for (auto& task : dropped_tasks) {
+        task(true);
+    }
+}
+
+/*
+ * Corresponding Python function definition
+ * async def gst.match_async(pattern: str/bytes, pattern_marks: str/bytes, text: str/bytes, text_marks: str/bytes, minimum_match_length: uint):
+ *     #stuff
+ *     return [(pattern_begin, text_begin, match_length) for ... in matches]
+ */
+static PyObject*
+gst_match_async(PyObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+    ModuleState* state = get_module_state(self);
+    MatchArguments parsed;
+    if (!parse_match_arguments(state, args, nargs, kwnames, parsed)) {
+        return (PyObject*)NULL;
+    }
+
+    // Raises RuntimeError if there is no running event loop
+    PyObject* loop = PyObject_CallObject(state->get_running_loop, NULL);
+    if (loop == (PyObject*)NULL) {
+        return (PyObject*)NULL;
+    }
+    PyObject* future = PyObject_CallMethod(loop, "create_future", NULL);
+    if (future == (PyObject*)NULL) {
+        Py_DECREF(loop);
+        return (PyObject*)NULL;
+    }
+
+    // Let the job know if the future is cancelled before the job starts
+    auto cancelled = std::make_shared<CancelFlag>(false);
+    auto cancelled_ptr = new (std::nothrow) std::shared_ptr<CancelFlag>(cancelled);
+    PyObject* capsule = cancelled_ptr == NULL ? (PyObject*)NULL : PyCapsule_New(cancelled_ptr, "gst.CancelFlag", cancel_flag_destructor);
+    if (capsule == (PyObject*)NULL) {
+        delete cancelled_ptr;
+        Py_DECREF(future);
+        Py_DECREF(loop);
+        return PyErr_NoMemory();
+    }
+    PyObject* on_done = PyCFunction_New(&on_future_done_definition, capsule);
+    Py_DECREF(capsule);
+    PyObject* py_added = on_done == (PyObject*)NULL ? (PyObject*)NULL : PyObject_CallMethod(future, "add_done_callback", "O", on_done);
+    Py_XDECREF(on_done);
+    if (py_added == (PyObject*)NULL) {
+        Py_DECREF(future);
+        Py_DECREF(loop);
+        return (PyObject*)NULL;
+    }
+    Py_DECREF(py_added);
+
+    // The job owns the reference to loop and one reference to future and both callables completing it
+    Py_INCREF(future);
+    Py_INCREF(state->future_set_result);
+    Py_INCREF(state->future_set_exception);
+    auto job = std::make_shared<MatchJob>(MatchJob {
+        std::string(parsed.pattern, parsed.pattern_length),
+        std::string(parsed.pattern_marks, parsed.pattern_marks_length),
+        std::string(parsed.text, parsed.text_length),
+        std::string(parsed.text_marks, parsed.text_marks_length),
+        parsed.minimum_match_length,
+        cancelled,
+        PyInterpreterState_Get(),
+        state->future_set_result,
+        state->future_set_exception,
+        loop,
+        future,
+    });
+
+    const char* error = NULL;
+    {
+        PoolState* pool_state = state->pool_state;
+        std::lock_guard<std::mutex> lock(pool_state->mutex);
+        if (!pool_state->pool) {
+            const Py_ssize_t size = pool_state->size > 0 ? pool_state->size : (Py_ssize_t)std::thread::hardware_concurrency();
+            try {
+                pool_state->pool.reset(new WorkerPool(size));
+            } catch (const std::exception&) {
+                error = "Unable to start the worker pool";
+            }
+        }
+        if (error == NULL and !pool_state->pool->submit([job](bool dropped) { run_match_job(job, dropped); })) {
+            error = "The worker pool has been shut down";
+        }
+    }
+    if (error != NULL) {
+        Py_DECREF(state->future_set_exception);
+        Py_DECREF(state->future_set_result);
+        Py_DECREF(future);
+        Py_DECREF(future);
+        Py_DECREF(loop);
+        PyErr_SetString(PyExc_RuntimeError, error);
+        return (PyObject*)NULL;
+    }
+
+    return future;
+}
+
+
+/*
+ * Corresponding Python function definition
+ * def gst.set_pool_size(size: uint):
+ *     #stuff
+ */
+static PyObject*
+gst_set_pool_size(PyObject* self, PyObject* args)
+{
+    ModuleState* state = get_module_state(self);
+    Py_ssize_t size;
+
+    if (!PyArg_ParseTuple(args, "n", &size)) {
+        PyErr_SetString(state->MatchError, "Invalid arguments, please see docstring");
+        return (PyObject*)NULL;
+    }
+    if (size < 0) {
+        PyErr_SetString(state->MatchError, "Pool size must not be negative");
+        return (PyObject*)NULL;
+    }
+
+    // Jobs submitted to the current pool are completed, the next call to match_async starts a new pool
+    {
+        std::lock_guard<std::mutex> lock(state->pool_state->mutex);
+        state->pool_state->size = size;
+    }
+    stop_worker_pool(state->pool_state, true);
+
+    Py_RETURN_NONE;
+}
+
+
+/*
+ * Stop the worker pool at interpreter exit, before the workers could no longer attach to the interpreter.
+ */
+static PyObject*
+gst_shutdown_pool(PyObject* self, PyObject* Py_UNUSED(ignored))
+{
+    stop_worker_pool(get_module_state(self)->pool_state, false);
+    Py_RETURN_NONE;
+}
+
+
+/*
+ * Copy a Python sequence of (tokens, marks) pairs of str/bytes into documents.
+ * Return false with an exception set if the sequence is invalid.
+ */
+static bool
+parse_documents(ModuleState* state, PyObject* py_documents, std::vector<std::pair<std::string, std::string> >& documents)
+{
+    // Note that on success, py_documents_seq owns one reference to a list or tuple
+    PyObject* py_documents_seq = PySequence_Fast(py_documents, "Documents must be a sequence of (tokens, marks) pairs");
+    if (py_documents_seq == (PyObject*)NULL) {
+        return false;
+    }
+
+    bool parsed = true;
+    // The items are borrowed, so a list must not be resized by other threads while they are used
+    GST_BEGIN_CRITICAL_SECTION(py_documents_seq);
+    const Py_ssize_t documents_length = PySequence_Fast_GET_SIZE(py_documents_seq);
+    documents.reserve(documents_length);
+    for (Py_ssize_t i = 0; i < documents_length; ++i) {
+        const char* tokens_c_str;
+        Py_ssize_t tokens_length;
+        const char* marks_c_str;
+        Py_ssize_t marks_length;
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(py_documents_seq, i), "s#s#",
+                &tokens_c_str, &tokens_length,
+                &marks_c_str, &marks_length)) {
+            PyErr_SetString(state->MatchError, "Invalid document, expected a (tokens, marks) pair");
+            parsed = false;
+            break;
+        }
+        documents.emplace_back(
+                std::string(tokens_c_str, tokens_length),
+                std::string(marks_c_str, marks_length));
+    }
+    GST_END_CRITICAL_SECTION();
+    Py_DECREF(py_documents_seq);
+    return parsed;
+}
 
-    // Add a new Exception class to the gst module
-    MatchError = PyErr_NewException("gst.MatchError", NULL, NULL);
-    // Increment the reference counter to avoid a dangling pointer
-    // in case someone manages to delete the class from the module at runtime
-    Py_INCREF(MatchError);
-    PyModule_AddObject(module, "MatchError", MatchError);
 
-    return module;
+/*
+ * Corresponding Python function definition
+ * def gst.sketch_candidates(documents: [(str/bytes, str/bytes)], kgram_length: uint, threshold: float, bands: uint = 32, rows: uint = 4):
+ *     #stuff
+ *     return [(index_a, index_b, estimated_jaccard) for ... in candidates]
+ */
+static PyObject*
+gst_sketch_candidates(PyObject* self, PyObject* args)
+{
+    ModuleState* state = get_module_state(self);
+    PyObject* py_documents;
+    unsigned long kgram_length;
+    double threshold;
+    Py_ssize_t bands = 32;
+    Py_ssize_t rows = 4;
+
+    if (!PyArg_ParseTuple(args, "Okd|nn",
+            &py_documents,
+            &kgram_length,
+            &threshold,
+            &bands,
+            &rows)) {
+        PyErr_SetString(state->MatchError, "Invalid arguments, please see docstring");
+        return (PyObject*)NULL;
+    }
+    if (bands < 1 || rows < 1) {
+        PyErr_SetString(state->MatchError, "Both bands and rows must be positive");
+        return (PyObject*)NULL;
+    }
+
+    std::vector<std::pair<std::string, std::string> > documents;
+    if (!parse_documents(state, py_documents, documents)) {
+        return (PyObject*)NULL;
+    }
+
+    std::vector<CandidatePair> candidates;
+    Py_BEGIN_ALLOW_THREADS
+    candidates = sketch_candidates(documents, kgram_length, threshold, bands, rows);
+    Py_END_ALLOW_THREADS
+
+    // Build a list of 3-tuples from candidates and return it
+
+    PyObject* py_list_candidates = PyList_New((Py_ssize_t)candidates.size());
+    if (py_list_candidates == (PyObject*)NULL) {
+        return (PyObject*)NULL;
+    }
+
+    Py_ssize_t i = 0;
+    for (const auto& candidate : candidates) {
+        PyObject* py_tuple_candidate = Py_BuildValue("(nnd)",
+                (Py_ssize_t)candidate.a,
+                (Py_ssize_t)candidate.b,
+                candidate.similarity);
+        if (py_tuple_candidate == (PyObject*)NULL) {
+            Py_DECREF(py_list_candidates);
+            return (PyObject*)NULL;
+        }
+        PyList_SET_ITEM(py_list_candidates, i++, py_tuple_candidate);
+    }
+
+    return py_list_candidates;
+}
+
+
+/*
+ * Corresponding Python function definition
+ * def gst.match_one_to_many(query: str/bytes, query_marks: str/bytes, documents: [(str/bytes, str/bytes)], minimum_match_length: uint, shorter_as_pattern: bool = False):
+ *     #stuff
+ *     return [[(query_begin, document_begin, match_length) for ... in tiles] for ... in documents]
+ */
+static PyObject*
+gst_match_one_to_many(PyObject* self, PyObject* args)
+{
+    ModuleState* state = get_module_state(self);
+    PyObject* py_query;
+    PyObject* py_query_marks;
+    PyObject* py_documents;
+    unsigned long minimum_match_length;
+    int shorter_as_pattern = 0;
+    const char* query_c_str;
+    Py_ssize_t query_length;
+    const char* query_marks_c_str;
+    Py_ssize_t query_marks_length;
+
+    if (!PyArg_ParseTuple(args, "OOOk|p",
+            &py_query,
+            &py_query_marks,
+            &py_documents,
+            &minimum_match_length,
+            &shorter_as_pattern)
+            || !as_string(py_query, &query_c_str, &query_length)
+            || !as_string(py_query_marks, &query_marks_c_str, &query_marks_length)) {
+        PyErr_Clear();
+        PyErr_SetString(state->MatchError, "Invalid arguments, please see docstring");
+        return (PyObject*)NULL;
+    }
+    const std::string query(query_c_str, query_length);
+    const std::string query_marks(query_marks_c_str, query_marks_length);
+
+    std::vector<std::pair<std::string, std::string> > documents;
+    if (!parse_documents(state, py_documents, documents)) {
+        return (PyObject*)NULL;
+    }
+
+    std::vector<Tiles> all_tiles;
+    Py_BEGIN_ALLOW_THREADS
+    all_tiles = match_one_to_many(query, documents, minimum_match_length, query_marks, shorter_as_pattern);
+    Py_END_ALLOW_THREADS
+
+    // Build a list of lists of tiles, one for each document, and return it
+
+    PyObject* py_list_documents = PyList_New((Py_ssize_t)all_tiles.size());
+    if (py_list_documents == (PyObject*)NULL) {
+        return (PyObject*)NULL;
+    }
+
+    Py_ssize_t i = 0;
+    for (const auto& tiles : all_tiles) {
+        PyObject* py_list_tiles = tiles_to_list(tiles);
+        if (py_list_tiles == (PyObject*)NULL) {
+            Py_DECREF(py_list_documents);
+            return (PyObject*)NULL;
+        }
+        PyList_SET_ITEM(py_list_documents, i++, py_list_tiles);
+    }
+
+    return py_list_documents;
+}
+
+
+/*
+ * Corresponding Python function definition
+ * def gst.group_duplicates(documents: [(str/bytes, str/bytes)], ignore_marked: bool = False):
+ *     #stuff
+ *     return [[representative_index, duplicate_index, ...] for ... in classes]
+ */
+static PyObject*
+gst_group_duplicates(PyObject* self, PyObject* args)
+{
+    ModuleState* state = get_module_state(self);
+    PyObject* py_documents;
+    int ignore_marked = 0;
+
+    if (!PyArg_ParseTuple(args, "O|p", &py_documents, &ignore_marked)) {
+        PyErr_SetString(state->MatchError, "Invalid arguments, please see docstring");
+        return (PyObject*)NULL;
+    }
+
+    std::vector<std::pair<std::string, std::string> > documents;
+    if (!parse_documents(state, py_documents, documents)) {
+        return (PyObject*)NULL;
+    }
+
+    DuplicateClasses classes;
+    Py_BEGIN_ALLOW_THREADS
+    classes = group_duplicates(documents, ignore_marked);
+    Py_END_ALLOW_THREADS
+
+    // Build a list of lists of indexes from classes and return it
+
+    PyObject* py_list_classes = PyList_New((Py_ssize_t)classes.size());
+    if (py_list_classes == (PyObject*)NULL) {
+        return (PyObject*)NULL;
+    }
+
+    Py_ssize_t i = 0;
+    for (const auto& duplicates : classes) {
+        PyObject* py_list_duplicates = PyList_New((Py_ssize_t)duplicates.size());
+        if (py_list_duplicates == (PyObject*)NULL) {
+            Py_DECREF(py_list_classes);
+            return (PyObject*)NULL;
+        }
+        Py_ssize_t j = 0;
+        for (const auto& index : duplicates) {
+            PyObject* py_index = PyLong_FromSsize_t((Py_ssize_t)index);
+            if (py_index == (PyObject*)NULL) {
+                Py_DECREF(py_list_duplicates);
+                Py_DECREF(py_list_classes);
+                return (PyObject*)NULL;
+            }
+            PyList_SET_ITEM(py_list_duplicates, j++, py_index);
+        }
+        PyList_SET_ITEM(py_list_classes, i++, py_list_duplicates);
+    }
+
+    return py_list_classes;
+}
+
+
+// Define the TileSet type
+
+#define GST_TILESET_DOCSTRING "TileSet(tiles=()), a set of (pattern_index, text_index, match_length) tiles ordered by pattern_index, with O(log n) overlap checks. Tiles overlap if they share at least one index in the pattern or in the text."
+
+typedef struct {
+    PyObject_HEAD
+    TileSet* tileset;
+} TileSetObject;
+
+/*
+ * Create a new TileSet object that takes ownership of tileset.
+ */
+static PyObject*
+tileset_wrap(PyTypeObject* type, TileSet* tileset)
+{
+    if (tileset == (TileSet*)NULL) {
+        return PyErr_NoMemory();
+    }
+    TileSetObject* self = (TileSetObject*)type->tp_alloc(type, 0);
+    if (self == (TileSetObject*)NULL) {
+        delete tileset;
+        return (PyObject*)NULL;
+    }
+    self->tileset = tileset;
+    return (PyObject*)self;
+}
+
+static PyObject*
+tileset_new(PyTypeObject* type, PyObject* Py_UNUSED(args), PyObject* Py_UNUSED(kwargs))
+{
+    return tileset_wrap(type, new (std::nothrow) TileSet());
+}
+
+static int
+tileset_init(TileSetObject* self, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"tiles", NULL};
+    PyObject* py_tiles = (PyObject*)NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", (char**)keywords, &py_tiles)) {
+        return -1;
+    }
+    PyObject* py_tiles_seq = (PyObject*)NULL;
+    if (py_tiles != (PyObject*)NULL) {
+        py_tiles_seq = PySequence_Fast(py_tiles, "Tiles must be a sequence of (pattern_index, text_index, match_length) tuples");
+        if (py_tiles_seq == (PyObject*)NULL) {
+            return -1;
+        }
+    }
+    int result = 0;
+    // The items are borrowed, so a list must not be resized by other threads while they are used
+    GST_BEGIN_CRITICAL_SECTION2(self, py_tiles_seq == (PyObject*)NULL ? (PyObject*)self : py_tiles_seq);
+    self->tileset->clear();
+    const Py_ssize_t tiles_length = py_tiles_seq == (PyObject*)NULL ? 0 : PySequence_Fast_GET_SIZE(py_tiles_seq);
+    for (Py_ssize_t i = 0; i < tiles_length; ++i) {
+        unsigned long pattern_index, text_index, match_length;
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(py_tiles_seq, i), "kkk", &pattern_index, &text_index, &match_length)) {
+            result = -1;
+            break;
+        }
+        self->tileset->add({ pattern_index, text_index, match_length });
+    }
+    GST_END_CRITICAL_SECTION2();
+    Py_XDECREF(py_tiles_seq);
+    return result;
+}
+
+static void
+tileset_dealloc(TileSetObject* self)
+{
+    // Instances of heap types own a reference to their type
+    PyTypeObject* type = Py_TYPE(self);
+    delete self->tileset;
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyObject*
+tileset_add(TileSetObject* self, PyObject* args)
+{
+    unsigned long pattern_index, text_index, match_length;
+    if (!PyArg_ParseTuple(args, "kkk", &pattern_index, &text_index, &match_length)) {
+        return (PyObject*)NULL;
+    }
+    GST_BEGIN_CRITICAL_SECTION(self);
+    self->tileset->add({ pattern_index, text_index, match_length });
+    GST_END_CRITICAL_SECTION();
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+tileset_add_non_overlapping(TileSetObject* self, PyObject* args)
+{
+    unsigned long pattern_index, text_index, match_length;
+    if (!PyArg_ParseTuple(args, "kkk", &pattern_index, &text_index, &match_length)) {
+        return (PyObject*)NULL;
+    }
+    bool added;
+    GST_BEGIN_CRITICAL_SECTION(self);
+    added = self->tileset->add_non_overlapping({ pattern_index, text_index, match_length });
+    GST_END_CRITICAL_SECTION();
+    return PyBool_FromLong(added);
+}
+
+static PyObject*
+tileset_overlaps(TileSetObject* self, PyObject* args)
+{
+    unsigned long pattern_index, text_index, match_length;
+    if (!PyArg_ParseTuple(args, "kkk", &pattern_index, &text_index, &match_length)) {
+        return (PyObject*)NULL;
+    }
+    bool overlaps;
+    GST_BEGIN_CRITICAL_SECTION(self);
+    overlaps = self->tileset->overlaps({ pattern_index, text_index, match_length });
+    GST_END_CRITICAL_SECTION();
+    return PyBool_FromLong(overlaps);
+}
+
+static PyObject*
+tileset_extend(TileSetObject* self, PyObject* args)
+{
+    PyObject* other;
+    if (!PyArg_ParseTuple(args, "O", &other)) {
+        return (PyObject*)NULL;
+    }
+    if (!PyObject_TypeCheck(other, Py_TYPE(self))) {
+        PyErr_SetString(PyExc_TypeError, "Expected a TileSet");
+        return (PyObject*)NULL;
+    }
+    GST_BEGIN_CRITICAL_SECTION2(self, other);
+    self->tileset->extend(*((TileSetObject*)other)->tileset);
+    GST_END_CRITICAL_SECTION2();
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+tileset_clear(TileSetObject* self, PyObject* Py_UNUSED(ignored))
+{
+    GST_BEGIN_CRITICAL_SECTION(self);
+    self->tileset->clear();
+    GST_END_CRITICAL_SECTION();
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+tileset_all(TileSetObject* self, PyObject* Py_UNUSED(ignored))
+{
+    // Build a list of 3-tuples from tiles in pattern index order and return it
+    PyObject* py_list_tiles;
+    GST_BEGIN_CRITICAL_SECTION(self);
+    py_list_tiles = PyList_New((Py_ssize_t)self->tileset->size());
+    Py_ssize_t i = 0;
+    for (auto it = self->tileset->begin(); py_list_tiles != (PyObject*)NULL and it != self->tileset->end(); ++it) {
+        const auto& tile = it->second;
+        PyObject* py_tuple_tile = Py_BuildValue("(kkk)", tile.pattern_index, tile.text_index, tile.match_length);
+        if (py_tuple_tile == (PyObject*)NULL) {
+            Py_CLEAR(py_list_tiles);
+            break;
+        }
+        PyList_SET_ITEM(py_list_tiles, i++, py_tuple_tile);
+    }
+    GST_END_CRITICAL_SECTION();
+    return py_list_tiles;
+}
+
+static PyObject*
+tileset_iter(TileSetObject* self)
+{
+    PyObject* py_list_tiles = tileset_all(self, (PyObject*)NULL);
+    if (py_list_tiles == (PyObject*)NULL) {
+        return (PyObject*)NULL;
+    }
+    PyObject* py_iter = PyObject_GetIter(py_list_tiles);
+    Py_DECREF(py_list_tiles);
+    return py_iter;
+}
+
+static Py_ssize_t
+tileset_len(TileSetObject* self)
+{
+    Py_ssize_t size;
+    GST_BEGIN_CRITICAL_SECTION(self);
+    size = (Py_ssize_t)self->tileset->size();
+    GST_END_CRITICAL_SECTION();
+    return size;
+}
+
+static PyObject*
+tileset_reverse(TileSetObject* self, PyObject* Py_UNUSED(ignored))
+{
+    TileSet* reversed;
+    GST_BEGIN_CRITICAL_SECTION(self);
+    reversed = new (std::nothrow) TileSet(self->tileset->reversed());
+    GST_END_CRITICAL_SECTION();
+    return tileset_wrap(Py_TYPE(self), reversed);
+}
+
+static PyObject*
+tileset_match_count(TileSetObject* self, PyObject* Py_UNUSED(ignored))
+{
+    return PyLong_FromSsize_t(tileset_len(self));
+}
+
+static PyObject*
+tileset_token_count(TileSetObject* self, PyObject* Py_UNUSED(ignored))
+{
+    match_length_t token_count;
+    GST_BEGIN_CRITICAL_SECTION(self);
+    token_count = self->tileset->token_count();
+    GST_END_CRITICAL_SECTION();
+    return PyLong_FromUnsignedLong(token_count);
+}
+
+static PyObject*
+tileset_json(TileSetObject* self, PyObject* Py_UNUSED(ignored))
+{
+    std::string json;
+    GST_BEGIN_CRITICAL_SECTION(self);
+    json = self->tileset->json();
+    GST_END_CRITICAL_SECTION();
+    return PyUnicode_FromStringAndSize(json.data(), (Py_ssize_t)json.size());
+}
+
+static PyObject*
+tileset_to_bytes(TileSetObject* self, PyObject* Py_UNUSED(ignored))
+{
+    std::string bytes;
+    GST_BEGIN_CRITICAL_SECTION(self);
+    bytes = self->tileset->to_bytes();
+    GST_END_CRITICAL_SECTION();
+    return PyBytes_FromStringAndSize(bytes.data(), (Py_ssize_t)bytes.size());
+}
+
+static PyObject*
+tileset_from_bytes(PyTypeObject* type, PyObject* args)
+{
+    const char* bytes_c_str;
+    Py_ssize_t bytes_length;
+    if (!PyArg_ParseTuple(args, "y#", &bytes_c_str, &bytes_length)) {
+        return (PyObject*)NULL;
+    }
+    TileSet* tileset = new (std::nothrow) TileSet();
+    if (tileset != (TileSet*)NULL and not TileSet::from_bytes(std::string(bytes_c_str, bytes_length), *tileset)) {
+        delete tileset;
+        const ModuleState* state = (ModuleState*)PyType_GetModuleState(type);
+        if (state != NULL) {
+            PyErr_SetString(state->MatchError, "Malformed TileSet bytes");
+        }
+        return (PyObject*)NULL;
+    }
+    return tileset_wrap(type, tileset);
+}
+
+static PyObject*
+tileset_full_match_from_length(PyTypeObject* type, PyObject* args)
+{
+    unsigned long length;
+    if (!PyArg_ParseTuple(args, "k", &length)) {
+        return (PyObject*)NULL;
+    }
+    return tileset_wrap(type, new (std::nothrow) TileSet(TileSet::full_match(length)));
+}
+
+static PyMethodDef tileset_methods[] = {
+    {"add", (PyCFunction)tileset_add, METH_VARARGS, "add(pattern_index, text_index, match_length), add a tile without checking for overlaps"},
+    {"add_non_overlapping", (PyCFunction)tileset_add_non_overlapping, METH_VARARGS, "add_non_overlapping(pattern_index, text_index, match_length), add a tile if it does not overlap any tile in the set and return True if it was added"},
+    {"overlaps", (PyCFunction)tileset_overlaps, METH_VARARGS, "overlaps(pattern_index, text_index, match_length), return True if the tile overlaps some tile in the set"},
+    {"extend", (PyCFunction)tileset_extend, METH_VARARGS, "extend(other), add all tiles of another TileSet without checking for overlaps"},
+    {"clear", (PyCFunction)tileset_clear, METH_NOARGS, "Remove all tiles"},
+    {"all", (PyCFunction)tileset_all, METH_NOARGS, "Return a list of all tiles as 3-tuples in pattern index order"},
+    {"reverse", (PyCFunction)tileset_reverse, METH_NOARGS, "Return a new TileSet with pattern and text indexes swapped"},
+    {"match_count", (PyCFunction)tileset_match_count, METH_NOARGS, "Return the amount of tiles"},
+    {"token_count", (PyCFunction)tileset_token_count, METH_NOARGS, "Return the sum of all match lengths"},
+    {"json", (PyCFunction)tileset_json, METH_NOARGS, "Return all tiles as a compact JSON array of [pattern_index, text_index, match_length] arrays in pattern index order"},
+    {"to_bytes", (PyCFunction)tileset_to_bytes, METH_NOARGS, "Return a compact binary representation of all tiles"},
+    {"from_bytes", (PyCFunction)tileset_from_bytes, METH_VARARGS | METH_CLASS, "from_bytes(bytes), create a TileSet from the output of to_bytes"},
+    {"full_match_from_length", (PyCFunction)tileset_full_match_from_length, METH_VARARGS | METH_CLASS, "full_match_from_length(length), create a TileSet with the single tile (0, 0, length)"},
+    {NULL, NULL, 0, NULL} // Sentinel
+};
+
+static PyType_Slot tileset_slots[] = {
+    {Py_tp_doc, (void*)GST_TILESET_DOCSTRING},
+    {Py_tp_new, (void*)tileset_new},
+    {Py_tp_init, (void*)tileset_init},
+    {Py_tp_dealloc, (void*)tileset_dealloc},
+    {Py_tp_iter, (void*)tileset_iter},
+    {Py_tp_methods, (void*)tileset_methods},
+    {Py_sq_length, (void*)tileset_len},
+    {0, NULL} // Sentinel
+};
+
+static PyType_Spec tileset_spec = {
+    "gst.TileSet",                  // name
+    sizeof(TileSetObject),          // basicsize
+    0,                              // itemsize
+#ifdef Py_TPFLAGS_IMMUTABLETYPE
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+#else
+    Py_TPFLAGS_DEFAULT,
+#endif
+    tileset_slots
+};
+
+
+// Define the ResultCache type
+
+#define GST_RESULT_CACHE_DOCSTRING "ResultCache(path), a persistent cache of match results in the file at path, created if it does not exist. The file may be shared by any amount of processes and threads on one host. Results are keyed by a SHA-256 digest of the match arguments and the matching engine version, so the file never returns results of an older engine"
+
+typedef struct {
+    PyObject_HEAD
+    ResultCache* cache;
+} ResultCacheObject;
+
+static PyObject*
+result_cache_new(PyTypeObject* type, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = {"path", NULL};
+    PyObject* py_path = (PyObject*)NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O&", (char**)keywords, PyUnicode_FSConverter, &py_path)) {
+        return (PyObject*)NULL;
+    }
+    const std::string path(PyBytes_AS_STRING(py_path), PyBytes_GET_SIZE(py_path));
+    ResultCache* cache = (ResultCache*)NULL;
+    try {
+        cache = new ResultCache(path);
+    } catch (const std::system_error& error) {
+        errno = error.code().value();
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, py_path);
+    } catch (const std::invalid_argument& error) {
+        PyErr_SetString(PyExc_ValueError, error.what());
+    } catch (const std::bad_alloc&) {
+        PyErr_NoMemory();
+    }
+    Py_DECREF(py_path);
+    if (cache == (ResultCache*)NULL) {
+        return (PyObject*)NULL;
+    }
+    ResultCacheObject* self = (ResultCacheObject*)type->tp_alloc(type, 0);
+    if (self == (ResultCacheObject*)NULL) {
+        delete cache;
+        return (PyObject*)NULL;
+    }
+    self->cache = cache;
+    return (PyObject*)self;
+}
+
+static void
+result_cache_dealloc(ResultCacheObject* self)
+{
+    PyTypeObject* type = Py_TYPE(self);
+    delete self->cache;
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyObject*
+result_cache_match(ResultCacheObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+    MatchArguments parsed;
+    if (!parse_match_arguments((ModuleState*)PyType_GetModuleState(Py_TYPE(self)), args, nargs, kwnames, parsed)) {
+        return (PyObject*)NULL;
+    }
+    // Same as gst.match, nothing is stored for texts that cannot contain a match
+    if (parsed.text_length < (Py_ssize_t)parsed.minimum_match_length) {
+        return PyList_New(0);
+    }
+    const std::string pattern(parsed.pattern, parsed.pattern_length);
+    const std::string text(parsed.text, parsed.text_length);
+    const std::string pattern_marks_str(parsed.pattern_marks, parsed.pattern_marks_length);
+    const std::string text_marks_str(parsed.text_marks, parsed.text_marks_length);
+
+    // The cache has its own locks, both for threads and for processes sharing the file
+    Tiles matches;
+    Py_BEGIN_ALLOW_THREADS
+    matches = self->cache->match(pattern, text, parsed.minimum_match_length, pattern_marks_str, text_marks_str);
+    Py_END_ALLOW_THREADS
+
+    return tiles_to_list(matches);
+}
+
+static PyObject*
+result_cache_get(ResultCacheObject* self, PyObject* const* args, Py_ssize_t nargs, PyObject* kwnames)
+{
+    MatchArguments parsed;
+    if (!parse_match_arguments((ModuleState*)PyType_GetModuleState(Py_TYPE(self)), args, nargs, kwnames, parsed)) {
+        return (PyObject*)NULL;
+    }
+    const auto& key = result_cache_key(
+            std::string(parsed.pattern, parsed.pattern_length),
+            std::string(parsed.text, parsed.text_length),
+            parsed.minimum_match_length,
+            std::string(parsed.pattern_marks, parsed.pattern_marks_length),
+            std::string(parsed.text_marks, parsed.text_marks_length));
+    Tiles matches;
+    bool found;
+    Py_BEGIN_ALLOW_THREADS
+    found = self->cache->find(key, matches);
+    Py_END_ALLOW_THREADS
+    if (!found) {
+        Py_RETURN_NONE;
+    }
+    return tiles_to_list(matches);
+}
+
+static Py_ssize_t
+result_cache_len(ResultCacheObject* self)
+{
+    Py_ssize_t size;
+    Py_BEGIN_ALLOW_THREADS
+    size = (Py_ssize_t)self->cache->size();
+    Py_END_ALLOW_THREADS
+    return size;
+}
+
+static PyMethodDef result_cache_methods[] = {
+    {"match", (PyCFunction)(void(*)(void))result_cache_match, METH_FASTCALL | METH_KEYWORDS, "Takes the same 5 arguments as gst.match and returns the same list, from the cache if it has been stored by any process, else by matching and storing the result"},
+    {"get", (PyCFunction)(void(*)(void))result_cache_get, METH_FASTCALL | METH_KEYWORDS, "Takes the same 5 arguments as gst.match. Returns the stored list of tiles, or None if no result has been stored"},
+    {NULL, NULL, 0, NULL} // Sentinel
+};
+
+static PyType_Slot result_cache_slots[] = {
+    {Py_tp_doc, (void*)GST_RESULT_CACHE_DOCSTRING},
+    {Py_tp_new, (void*)result_cache_new},
+    {Py_tp_dealloc, (void*)result_cache_dealloc},
+    {Py_tp_methods, (void*)result_cache_methods},
+    {Py_sq_length, (void*)result_cache_len},
+    {0, NULL} // Sentinel
+};
+
+static PyType_Spec result_cache_spec = {
+    "gst.ResultCache",              // name
+    sizeof(ResultCacheObject),      // basicsize
+    0,                              // itemsize
+#ifdef Py_TPFLAGS_IMMUTABLETYPE
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+#else
+    Py_TPFLAGS_DEFAULT,
+#endif
+    result_cache_slots
+};
+
+
+/*
+ * Copy a Python sequence of one uint weight per document into weights.
+ * Return false with an exception set if the sequence is invalid.
+ */
+static bool
+parse_weights(ModuleState* state, PyObject* py_weights, const std::size_t& document_count, std::vector<std::size_t>& weights)
+{
+    // Note that on success, py_weights_seq owns one reference to a list or tuple
+    PyObject* py_weights_seq = PySequence_Fast(py_weights, "Weights must be a sequence of uint");
+    if (py_weights_seq == (PyObject*)NULL) {
+        return false;
+    }
+
+    bool parsed = true;
+    // The items are borrowed, so a list must not be resized by other threads while they are used
+    GST_BEGIN_CRITICAL_SECTION(py_weights_seq);
+    const Py_ssize_t weights_length = PySequence_Fast_GET_SIZE(py_weights_seq);
+    if ((std::size_t)weights_length != document_count) {
+        PyErr_SetString(state->MatchError, "Weights must contain one weight per document");
+        parsed = false;
+    }
+    for (Py_ssize_t i = 0; parsed and i < weights_length; ++i) {
+        const std::size_t weight = PyLong_AsSize_t(PySequence_Fast_GET_ITEM(py_weights_seq, i));
+        if (weight == (std::size_t)-1 and PyErr_Occurred()) {
+            PyErr_SetString(state->MatchError, "Invalid weight, expected a uint");
+            parsed = false;
+        }
+        weights.push_back(weight);
+    }
+    GST_END_CRITICAL_SECTION();
+    Py_DECREF(py_weights_seq);
+    return parsed;
+}
+
+
+/*
+ * Arguments of match_all_pairs and match_all_pairs_iter.
+ * cache is borrowed from py_cache, which is borrowed from the arguments.
+ */
+struct AllPairsArguments {
+    std::vector<std::pair<std::string, std::string> > documents;
+    unsigned long minimum_match_length;
+    Py_ssize_t block_size = (Py_ssize_t)default_all_pairs_block_size;
+    PyObject* py_cache = Py_None;
+    ResultCache* cache = (ResultCache*)NULL;
+    bool has_cutoff = false;
+    SimilarityCutoff cutoff = { 0.0, {} };
+};
+
+/*
+ * Parse the arguments of match_all_pairs and match_all_pairs_iter into parsed.
+ * Return false with an exception set if they are invalid.
+ */
+static bool
+parse_all_pairs_arguments(ModuleState* state, PyObject* args, AllPairsArguments& parsed)
+{
+    PyObject* py_documents;
+    PyObject* py_minimum_similarity = Py_None;
+    PyObject* py_weights = Py_None;
+
+    if (!PyArg_ParseTuple(args, "Ok|nOOO",
+            &py_documents,
+            &parsed.minimum_match_length,
+            &parsed.block_size,
+            &parsed.py_cache,
+            &py_minimum_similarity,
+            &py_weights)) {
+        PyErr_SetString(state->MatchError, "Invalid arguments, please see docstring");
+        return false;
+    }
+    if (parsed.block_size < 0) {
+        PyErr_SetString(state->MatchError, "Block size must not be negative");
+        return false;
+    }
+    if (parsed.py_cache != Py_None and !PyObject_TypeCheck(parsed.py_cache, state->ResultCacheType)) {
+        PyErr_SetString(state->MatchError, "Cache must be a ResultCache or None");
+        return false;
+    }
+    if (parsed.py_cache != Py_None) {
+        parsed.cache = ((ResultCacheObject*)parsed.py_cache)->cache;
+    }
+
+    if (!parse_documents(state, py_documents, parsed.documents)) {
+        return false;
+    }
+
+    if (py_minimum_similarity != Py_None) {
+        parsed.has_cutoff = true;
+        parsed.cutoff.minimum_similarity = PyFloat_AsDouble(py_minimum_similarity);
+        if (parsed.cutoff.minimum_similarity == -1.0 and PyErr_Occurred()) {
+            PyErr_SetString(state->MatchError, "Minimum similarity must be a float or None");
+            return false;
+        }
+    }
+    return py_weights == Py_None or parse_weights(state, py_weights, parsed.documents.size(), parsed.cutoff.weights);
+}
+
+/*
+ * Create a 3-tuple (index_a, index_b, tiles) of a pair.
+ */
+static PyObject*
+pair_to_tuple(const PairTiles& pair)
+{
+    PyObject* py_list_tiles = tiles_to_list(pair.tiles);
+    if (py_list_tiles == (PyObject*)NULL) {
+        return (PyObject*)NULL;
+    }
+    return Py_BuildValue("(nnN)", (Py_ssize_t)pair.a, (Py_ssize_t)pair.b, py_list_tiles);
+}
+
+/*
+ * Corresponding Python function definition
+ * def gst.match_all_pairs(documents: [(str/bytes, str/bytes)], minimum_match_length: uint, block_size: int = 131072, cache: ResultCache = None,
+ *                        minimum_similarity: float = None, weights: [uint] = None):
+ *     #stuff
+ *     return [(index_a, index_b, [(index_in_a, index_in_b, match_length) for ... in tiles]) for ... in pairs]
+ */
+static PyObject*
+gst_match_all_pairs(PyObject* self, PyObject* args)
+{
+    ModuleState* state = get_module_state(self);
+    AllPairsArguments parsed;
+    if (!parse_all_pairs_arguments(state, args, parsed)) {
+        return (PyObject*)NULL;
+    }
+
+    // The cache object stays alive while the GIL is released, since the argument tuple owns a reference to it
+    AllPairsTiles all_pairs_tiles;
+    Py_BEGIN_ALLOW_THREADS
+    all_pairs_tiles = match_all_pairs(parsed.documents, parsed.minimum_match_length, parsed.block_size, HashingMode::rolling, parsed.cache,
+            parsed.has_cutoff ? &parsed.cutoff : (SimilarityCutoff*)NULL);
+    Py_END_ALLOW_THREADS
+
+    // Build a list of 3-tuples (index_a, index_b, tiles) from all pairs and return it
+
+    PyObject* py_list_pairs = PyList_New((Py_ssize_t)all_pairs_tiles.size());
+    if (py_list_pairs == (PyObject*)NULL) {
+        return (PyObject*)NULL;
+    }
+
+    Py_ssize_t i = 0;
+    for (const auto& pair : all_pairs_tiles) {
+        PyObject* py_tuple_pair = pair_to_tuple(pair);
+        if (py_tuple_pair == (PyObject*)NULL) {
+            Py_DECREF(py_list_pairs);
+            return (PyObject*)NULL;
+        }
+        PyList_SET_ITEM(py_list_pairs, i++, py_tuple_pair);
+    }
+
+    return py_list_pairs;
+}
+
+
+// Define the AllPairsIterator type
+
+#define GST_ALL_PAIRS_ITERATOR_DOCSTRING "Iterator over the pairs of documents, created by match_all_pairs_iter"
+
+/*
+ * Resumable matching of an AllPairsIterator.
+ * The mutex is held while advancing the stream, which is done without holding the GIL.
+ */
+struct AllPairsIteration {
+    AllPairsIteration(const AllPairsArguments& parsed) :
+        stream(parsed.documents, parsed.minimum_match_length, parsed.block_size, HashingMode::rolling, parsed.cache,
+                parsed.has_cutoff ? &parsed.cutoff : (SimilarityCutoff*)NULL) {}
+
+    AllPairsStream stream;
+    // Pairs of the latest block, of which the first block_index have been yielded
+    AllPairsTiles block_pairs;
+    std::size_t block_index = 0;
+    std::mutex mutex;
+};
+
+typedef struct {
+    PyObject_HEAD
+    AllPairsIteration* iteration;
+    // ResultCache used by the stream, or None
+    PyObject* py_cache;
+} AllPairsIteratorObject;
+
+static void
+all_pairs_iterator_dealloc(AllPairsIteratorObject* self)
+{
+    // Instances of heap types own a reference to their type
+    PyTypeObject* type = Py_TYPE(self);
+    delete self->iteration;
+    Py_XDECREF(self->py_cache);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static PyObject*
+all_pairs_iterator_next(AllPairsIteratorObject* self)
+{
+    AllPairsIteration* iteration = self->iteration;
+    if (!iteration->mutex.try_lock()) {
+        // Another thread is advancing the stream, wait for it without blocking threads that need the GIL
+        Py_BEGIN_ALLOW_THREADS
+        iteration->mutex.lock();
+        Py_END_ALLOW_THREADS
+    }
+    // Blocks may keep no pairs, e.g. below a similarity cutoff
+    while (iteration->block_index == iteration->block_pairs.size() and not iteration->stream.finished()) {
+        iteration->block_pairs.clear();
+        iteration->block_index = 0;
+        Py_BEGIN_ALLOW_THREADS
+        iteration->stream.next(iteration->block_pairs);
+        Py_END_ALLOW_THREADS
+    }
+    PyObject* py_tuple_pair = (PyObject*)NULL;
+    if (iteration->block_index < iteration->block_pairs.size()) {
+        py_tuple_pair = pair_to_tuple(iteration->block_pairs[iteration->block_index++]);
+    }
+    iteration->mutex.unlock();
+    // Returning NULL without an exception stops the iteration
+    return py_tuple_pair;
+}
+
+static PyType_Slot all_pairs_iterator_slots[] = {
+    {Py_tp_doc, (void*)GST_ALL_PAIRS_ITERATOR_DOCSTRING},
+    {Py_tp_dealloc, (void*)all_pairs_iterator_dealloc},
+    {Py_tp_iter, (void*)PyObject_SelfIter},
+    {Py_tp_iternext, (void*)all_pairs_iterator_next},
+    {0, NULL} // Sentinel
+};
+
+static PyType_Spec all_pairs_iterator_spec = {
+    "gst.AllPairsIterator",         // name
+    sizeof(AllPairsIteratorObject), // basicsize
+    0,                              // itemsize
+#ifdef Py_TPFLAGS_DISALLOW_INSTANTIATION
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+#else
+    Py_TPFLAGS_DEFAULT,
+#endif
+    all_pairs_iterator_slots
+};
+
+/*
+ * Corresponding Python function definition
+ * def gst.match_all_pairs_iter(documents: [(str/bytes, str/bytes)], minimum_match_length: uint, block_size: int = 131072, cache: ResultCache = None,
+ *                             minimum_similarity: float = None, weights: [uint] = None):
+ *     #stuff
+ *     for ... in blocks:
+ *         yield from ((index_a, index_b, [(index_in_a, index_in_b, match_length) for ... in tiles]) for ... in block_pairs)
+ */
+static PyObject*
+gst_match_all_pairs_iter(PyObject* self, PyObject* args)
+{
+    ModuleState* state = get_module_state(self);
+    AllPairsArguments parsed;
+    if (!parse_all_pairs_arguments(state, args, parsed)) {
+        return (PyObject*)NULL;
+    }
+
+    AllPairsIteration* iteration;
+    // Hashing all documents may take a while
+    Py_BEGIN_ALLOW_THREADS
+    iteration = new (std::nothrow) AllPairsIteration(parsed);
+    Py_END_ALLOW_THREADS
+    if (iteration == (AllPairsIteration*)NULL) {
+        return PyErr_NoMemory();
+    }
+
+    PyTypeObject* type = state->AllPairsIteratorType;
+    AllPairsIteratorObject* iterator = (AllPairsIteratorObject*)type->tp_alloc(type, 0);
+    if (iterator == (AllPairsIteratorObject*)NULL) {
+        delete iteration;
+        return (PyObject*)NULL;
+    }
+    iterator->iteration = iteration;
+    // The stream uses the cache until the iterator is freed
+    Py_INCREF(parsed.py_cache);
+    iterator->py_cache = parsed.py_cache;
+    return (PyObject*)iterator;
+}
+
+
+// Define the Python module
+
+static PyMethodDef module_methods[] = {
+    {"match", (PyCFunction)(void(*)(void))gst_match, METH_FASTCALL | METH_KEYWORDS, GST_MATCH_DOCSTRING},
+    {"match_iter", (PyCFunction)(void(*)(void))gst_match_iter, METH_FASTCALL | METH_KEYWORDS, GST_MATCH_ITER_DOCSTRING},
+    {"match_async", (PyCFunction)(void(*)(void))gst_match_async, METH_FASTCALL | METH_KEYWORDS, GST_MATCH_ASYNC_DOCSTRING},
+    {"set_pool_size", gst_set_pool_size, METH_VARARGS, GST_SET_POOL_SIZE_DOCSTRING},
+    {"_shutdown_pool", gst_shutdown_pool, METH_NOARGS, NULL},
+    {"match_one_to_many", gst_match_one_to_many, METH_VARARGS, GST_MATCH_ONE_TO_MANY_DOCSTRING},
+    {"match_all_pairs", gst_match_all_pairs, METH_VARARGS, GST_MATCH_ALL_PAIRS_DOCSTRING},
+    {"match_all_pairs_iter", gst_match_all_pairs_iter, METH_VARARGS, GST_MATCH_ALL_PAIRS_ITER_DOCSTRING},
+    {"sketch_candidates", gst_sketch_candidates, METH_VARARGS, GST_SKETCH_CANDIDATES_DOCSTRING},
+    {"group_duplicates", gst_group_duplicates, METH_VARARGS, GST_GROUP_DUPLICATES_DOCSTRING},
+    {NULL, NULL, 0, NULL} // Sentinel
+};
+
+/*
+ * Initialize the state of a new module object, called once in each interpreter importing gst.
+ */
+static int
+module_exec(PyObject* module)
+{
+    ModuleState* state = get_module_state(module);
+
+    state->pool_state = new (std::nothrow) PoolState();
+    if (state->pool_state == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    // Add a new Exception class to the gst module
+    state->MatchError = PyErr_NewException("gst.MatchError", NULL, NULL);
+    if (state->MatchError == NULL) {
+        return -1;
+    }
+    // The module state keeps its own reference in case someone deletes the class from the module at runtime
+    Py_INCREF(state->MatchError);
+    if (PyModule_AddObject(module, "MatchError", state->MatchError) < 0) {
+        Py_DECREF(state->MatchError);
+        return -1;
+    }
+
+    state->TileSetType = (PyTypeObject*)PyType_FromModuleAndSpec(module, &tileset_spec, NULL);
+    if (state->TileSetType == NULL) {
+        return -1;
+    }
+    Py_INCREF(state->TileSetType);
+    if (PyModule_AddObject(module, "TileSet", (PyObject*)state->TileSetType) < 0) {
+        Py_DECREF(state->TileSetType);
+        return -1;
+    }
+
+    state->TileIteratorType = (PyTypeObject*)PyType_FromModuleAndSpec(module, &tile_iterator_spec, NULL);
+    if (state->TileIteratorType == NULL) {
+        return -1;
+    }
+    Py_INCREF(state->TileIteratorType);
+    if (PyModule_AddObject(module, "TileIterator", (PyObject*)state->TileIteratorType) < 0) {
+        Py_DECREF(state->TileIteratorType);
+        return -1;
+    }
+
+    state->AllPairsIteratorType = (PyTypeObject*)PyType_FromModuleAndSpec(module, &all_pairs_iterator_spec, NULL);
+    if (state->AllPairsIteratorType == NULL) {
+        return -1;
+    }
+    Py_INCREF(state->AllPairsIteratorType);
+    if (PyModule_AddObject(module, "AllPairsIterator", (PyObject*)state->AllPairsIteratorType) < 0) {
+        Py_DECREF(state->AllPairsIteratorType);
+        return -1;
+    }
+
+    state->ResultCacheType = (PyTypeObject*)PyType_FromModuleAndSpec(module, &result_cache_spec, NULL);
+    if (state->ResultCacheType == NULL) {
+        return -1;
+    }
+    Py_INCREF(state->ResultCacheType);
+    if (PyModule_AddObject(module, "ResultCache", (PyObject*)state->ResultCacheType) < 0) {
+        Py_DECREF(state->ResultCacheType);
+        return -1;
+    }
+
+    // Prepare asynchronous matching and stop its worker pool at interpreter exit
+    PyObject* asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio == NULL) {
+        return -1;
+    }
+    state->get_running_loop = PyObject_GetAttrString(asyncio, "get_running_loop");
+    Py_DECREF(asyncio);
+    PyObject* set_result_name = PyUnicode_InternFromString("set_result");
+    PyObject* set_exception_name = PyUnicode_InternFromString("set_exception");
+    if (set_result_name != NULL and set_exception_name != NULL) {
+        state->future_set_result = PyCFunction_New(&complete_future_definition, set_result_name);
+        state->future_set_exception = PyCFunction_New(&complete_future_definition, set_exception_name);
+    }
+    Py_XDECREF(set_result_name);
+    Py_XDECREF(set_exception_name);
+    if (state->get_running_loop == NULL or state->future_set_result == NULL or state->future_set_exception == NULL) {
+        return -1;
+    }
+    PyObject* py_registered = PyImport_ImportModule("atexit");
+    if (py_registered != NULL) {
+        PyObject* shutdown_pool = PyObject_GetAttrString(module, "_shutdown_pool");
+        PyObject* atexit = py_registered;
+        py_registered = shutdown_pool == NULL ? NULL : PyObject_CallMethod(atexit, "register", "O", shutdown_pool);
+        Py_XDECREF(shutdown_pool);
+        Py_DECREF(atexit);
+    }
+    if (py_registered == NULL) {
+        return -1;
+    }
+    Py_DECREF(py_registered);
+
+    return 0;
+}
+
+static int
+module_traverse(PyObject* module, visitproc visit, void* arg)
+{
+    ModuleState* state = get_module_state(module);
+    Py_VISIT(state->MatchError);
+    Py_VISIT(state->TileSetType);
+    Py_VISIT(state->TileIteratorType);
+    Py_VISIT(state->AllPairsIteratorType);
+    Py_VISIT(state->ResultCacheType);
+    Py_VISIT(state->get_running_loop);
+    Py_VISIT(state->future_set_result);
+    Py_VISIT(state->future_set_exception);
+    return 0;
+}
+
+static int
+module_clear(PyObject* module)
+{
+    ModuleState* state = get_module_state(module);
+    Py_CLEAR(state->MatchError);
+    Py_CLEAR(state->TileSetType);
+    Py_CLEAR(state->TileIteratorType);
+    Py_CLEAR(state->AllPairsIteratorType);
+    Py_CLEAR(state->ResultCacheType);
+    Py_CLEAR(state->get_running_loop);
+    Py_CLEAR(state->future_set_result);
+    Py_CLEAR(state->future_set_exception);
+    return 0;
+}
+
+static void
+module_free(void* module)
+{
+    ModuleState* state = get_module_state((PyObject*)module);
+    module_clear((PyObject*)module);
+    if (state->pool_state != NULL) {
+        // Jobs do not own a reference to the module, so this is never called by a worker of the pool
+        stop_worker_pool(state->pool_state, false);
+    }
+    delete state->pool_state;
+    state->pool_state = NULL;
+}
+
+static PyModuleDef_Slot module_slots[] = {
+    {Py_mod_exec, (void*)module_exec},
+#if PY_VERSION_HEX >= 0x030C0000
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#if PY_VERSION_HEX >= 0x030D0000
+    // Shared state is immutable, guarded by the mutex of the pool or by a critical section of its object
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL} // Sentinel
+};
+
+static struct PyModuleDef module_definition = {
+    PyModuleDef_HEAD_INIT,      // Boilerplate
+    "gst",                      // Module name, as in e.g. 'python3 -c "import gst"'
+    GSTMODULE_DOCSTRING,
+    sizeof(ModuleState),        // All state is in the module object, which allows sub-interpreters
+    module_methods,             // Module method table
+    module_slots,               // Multi-phase initialization
+    module_traverse,
+    module_clear,
+    module_free
+};
+
+PyMODINIT_FUNC
+PyInit_gst(void)
+{
+    return PyModuleDef_Init(&module_definition);
 }
@@ -0,0 +1,322 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "result_cache.hpp"
+
+/*
+ * The file starts with a header of 8 magic bytes and a 4 byte format version, padded to header_size.
+ * It is followed by records of
+ *   4 byte record_magic, 4 byte payload size, 32 byte key, payload, 4 byte checksum of key and payload,
+ * with integers in little-endian byte order.
+ * The payload is the amount of tiles followed by the pattern index, text index and length of each tile in the order of match_strings,
+ * all as unsigned LEB128 varints.
+ */
+static const char header_magic[8] = { 'G', 'S', 'T', 'C', 'A', 'C', 'H', 'E' };
+static const std::uint32_t format_version = 1u;
+static const std::uint64_t header_size = 16u;
+
+static const std::uint32_t record_magic = 0x52545347u;
+static const std::uint64_t record_key_offset = 8u;
+static const std::uint64_t record_payload_offset = record_key_offset + sizeof(CacheKey);
+static const std::uint64_t record_overhead = record_payload_offset + 4u;
+// Larger payloads are treated as corrupt
+static const std::uint32_t max_payload_size = 1u << 30;
+
+
+static void write_u32(std::string& bytes, const std::uint32_t& value) {
+    for (auto i = 0u; i < 4; ++i) {
+        bytes += static_cast<char>(value >> (8 * i));
+    }
+}
+
+
+static std::uint32_t read_u32(const char* bytes) noexcept {
+    std::uint32_t value = 0;
+    for (auto i = 0u; i < 4; ++i) {
+        value |= static_cast<std::uint32_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+    }
+    return value;
+}
+
+
+static void write_varint(std::string& bytes, match_length_t value) {
+    while (value >= 0x80u) {
+        bytes += static_cast<char>((value & 0x7fu) | 0x80u);
+        value >>= 7;
+    }
+    bytes += static_cast<char>(value);
+}
+
+
+static bool read_varint(const char* bytes, const std::size_t& size, std::size_t& pos, match_length_t& value) noexcept {
+    value = 0;
+    for (unsigned shift = 0; pos < size and shift < 8 * sizeof(match_length_t); shift += 7) {
+        const auto byte = static_cast<unsigned char>(bytes[pos++]);
+        value |= static_cast<match_length_t>(byte & 0x7fu) << shift;
+        if (not (byte & 0x80u)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// FNV-1a, for detecting partially written records
+static std::uint32_t checksum(const char* bytes, const std::size_t& size) noexcept {
+    std::uint32_t hash = 0x811c9dc5u;
+    for (auto i = 0u; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(bytes[i])) * 0x01000193u;
+    }
+    return hash;
+}
+
+
+CacheKey result_cache_key(
+        const std::string& pattern,
+        const std::string& text,
+        const match_length_t& init_search_length,
+        const std::string& init_pattern_marks,
+        const std::string& init_text_marks) noexcept {
+    Sha256 hasher;
+    const auto& update_u64 = [&hasher](const std::uint64_t& value) {
+        std::uint8_t bytes[8];
+        for (auto i = 0u; i < 8; ++i) {
+            bytes[i] = static_cast<std::uint8_t>(value >> (8 * i));
+        }
+        hasher.update(bytes, 8);
+    };
+    // Every field has a fixed size or is prefixed by its size, so different arguments never hash the same bytes
+    const auto& update_tokens = [&hasher, &update_u64](const std::string& tokens, const std::string& init_marks) {
+        update_u64(tokens.size());
+        hasher.update(tokens);
+        std::string marks(tokens.size(), '0');
+        for (auto i = 0u; i < tokens.size() and i < init_marks.size(); ++i) {
+            if (init_marks[i] == '1') {
+                marks[i] = '1';
+            }
+        }
+        hasher.update(marks);
+    };
+    update_u64(gst_engine_version);
+    update_u64(init_search_length);
+    update_tokens(pattern, init_pattern_marks);
+    update_tokens(text, init_text_marks);
+    return hasher.digest();
+}
+
+
+std::size_t ResultCache::KeyHash::operator()(const CacheKey& key) const noexcept {
+    // Keys are uniformly distributed
+    std::size_t hash;
+    std::memcpy(&hash, key.data(), sizeof(hash));
+    return hash;
+}
+
+
+ResultCache::ResultCache(const std::string& path) :
+    indexed_end(header_size) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Cannot open result cache " + path);
+    }
+    // Write or check the header under an exclusive lock, so that concurrent creators do not interleave
+    int error = flock(fd, LOCK_EX) == 0 ? 0 : errno;
+    bool is_cache = true;
+    struct stat file_stat;
+    if (error == 0 and fstat(fd, &file_stat) != 0) {
+        error = errno;
+    }
+    if (error == 0 and file_stat.st_size == 0) {
+        std::string header(header_magic, sizeof(header_magic));
+        write_u32(header, format_version);
+        header.resize(header_size, '\0');
+        if (pwrite(fd, header.data(), header.size(), 0) != static_cast<ssize_t>(header.size())) {
+            error = errno ? errno : EIO;
+        }
+    } else if (error == 0) {
+        char header[header_size];
+        is_cache = pread(fd, header, header_size, 0) == static_cast<ssize_t>(header_size)
+            and std::memcmp(header, header_magic, sizeof(header_magic)) == 0
+            and read_u32(header + sizeof(header_magic)) == format_version;
+    }
+    flock(fd, LOCK_UN);
+    if (error != 0 or not is_cache) {
+        ::close(fd);
+        if (error != 0) {
+            throw std::system_error(error, std::generic_category(), "Cannot initialize result cache " + path);
+        }
+        throw std::invalid_argument("Not a result cache of this version: " + path);
+    }
+}
+
+
+ResultCache::~ResultCache() {
+    if (mapping != nullptr) {
+        munmap(const_cast<char*>(mapping), mapped_size);
+    }
+    ::close(fd);
+}
+
+
+bool ResultCache::map(const std::uint64_t& size) noexcept {
+    if (size <= mapped_size) {
+        return true;
+    }
+    void* new_mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (new_mapping == MAP_FAILED) {
+        return false;
+    }
+    if (mapping != nullptr) {
+        munmap(const_cast<char*>(mapping), mapped_size);
+    }
+    mapping = static_cast<const char*>(new_mapping);
+    mapped_size = size;
+    return true;
+}
+
+
+void ResultCache::refresh() noexcept {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 or static_cast<std::uint64_t>(file_stat.st_size) <= indexed_end) {
+        return;
+    }
+    if (not map(file_stat.st_size)) {
+        return;
+    }
+    // Index all complete records, stopping at the end of the file or at a partially written record
+    auto pos = indexed_end;
+    while (pos + record_overhead <= static_cast<std::uint64_t>(file_stat.st_size)) {
+        const char* record = mapping + pos;
+        const auto& payload_size = read_u32(record + 4);
+        if (read_u32(record) != record_magic
+                or payload_size > max_payload_size
+                or pos + record_overhead + payload_size > static_cast<std::uint64_t>(file_stat.st_size)
+                or read_u32(record + record_payload_offset + payload_size) != checksum(record + record_key_offset, sizeof(CacheKey) + payload_size)) {
+            break;
+        }
+        CacheKey key;
+        std::memcpy(key.data(), record + record_key_offset, key.size());
+        index.emplace(key, Location{ pos + record_payload_offset, payload_size });
+        pos += record_overhead + payload_size;
+    }
+    indexed_end = pos;
+}
+
+
+bool ResultCache::find(const CacheKey& key, Tiles& tiles) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto location_it = index.find(key);
+    if (location_it == index.end()) {
+        // Some other process may have stored the key
+        if (flock(fd, LOCK_SH) != 0) {
+            return false;
+        }
+        refresh();
+        flock(fd, LOCK_UN);
+        location_it = index.find(key);
+        if (location_it == index.end()) {
+            return false;
+        }
+    }
+    const auto& location = location_it->second;
+    if (not map(location.offset + location.size)) {
+        return false;
+    }
+
+    const char* payload = mapping + location.offset;
+    std::size_t pos = 0;
+    match_length_t count;
+    if (not read_varint(payload, location.size, pos, count)) {
+        return false;
+    }
+    Tiles found;
+    found.reserve(std::min<match_length_t>(count, location.size));
+    for (auto i = 0u; i < count; ++i) {
+        match_length_t pattern_index, text_index, match_length;
+        if (not (read_varint(payload, location.size, pos, pattern_index)
+                 and read_varint(payload, location.size, pos, text_index)
+                 and read_varint(payload, location.size, pos, match_length))) {
+            return false;
+        }
+        found.push_back({ pattern_index, text_index, match_length });
+    }
+    for (const auto& tile : found) {
+        tiles.push_back(tile);
+    }
+    return true;
+}
+
+
+bool ResultCache::insert(const CacheKey& key, const Tiles& tiles) {
+    std::string payload;
+    write_varint(payload, tiles.size());
+    for (const auto& tile : tiles) {
+        write_varint(payload, tile.pattern_index);
+        write_varint(payload, tile.text_index);
+        write_varint(payload, tile.match_length);
+    }
+    if (payload.size() > max_payload_size) {
+        return false;
+    }
+    std::string record;
+    record.reserve(record_overhead + payload.size());
+    write_u32(record, record_magic);
+    write_u32(record, payload.size());
+    record.append(reinterpret_cast<const char*>(key.data()), key.size());
+    record += payload;
+    write_u32(record, checksum(record.data() + record_key_offset, sizeof(CacheKey) + payload.size()));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (flock(fd, LOCK_EX) != 0) {
+        return false;
+    }
+    refresh();
+    bool stored = index.count(key) > 0;
+    struct stat file_stat;
+    if (not stored and fstat(fd, &file_stat) == 0) {
+        const auto& file_size = static_cast<std::uint64_t>(file_stat.st_size);
+        // Bytes after the indexed records that have been scanned belong to a partially written record
+        const bool at_end = file_size == indexed_end
+            or (file_size <= mapped_size and ftruncate(fd, indexed_end) == 0);
+        if (at_end and pwrite(fd, record.data(), record.size(), indexed_end) == static_cast<ssize_t>(record.size())) {
+            index.emplace(key, Location{ indexed_end + record_payload_offset, static_cast<std::uint32_t>(payload.size()) });
+            indexed_end += record.size();
+            stored = true;
+        }
+    }
+    flock(fd, LOCK_UN);
+    return stored;
+}
+
+
+Tiles ResultCache::match(
+        const std::string& pattern,
+        const std::string& text,
+        const match_length_t& init_search_length,
+        const std::string& init_pattern_marks,
+        const std::string& init_text_marks) {
+    const auto& key = result_cache_key(pattern, text, init_search_length, init_pattern_marks, init_text_marks);
+    Tiles tiles;
+    if (find(key, tiles)) {
+        return tiles;
+    }
+    tiles = match_strings(pattern, text, init_search_length, init_pattern_marks, init_text_marks);
+    insert(key, tiles);
+    return tiles;
+}
+
+
+std::size_t ResultCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (flock(fd, LOCK_SH) == 0) {
+        refresh();
+        flock(fd, LOCK_UN);
+    }
+    return index.size();
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cstring>
+#include "sha256.hpp"
+
+
+static const std::uint32_t round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+
+inline std::uint32_t rotate_right(const std::uint32_t& x, const unsigned& n) noexcept {
+    return (x >> n) | (x << (32 - n));
+}
+
+
+Sha256::Sha256() noexcept :
+    state{{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 }},
+    buffer_size(0),
+    total_size(0) {}
+
+
+void Sha256::update(const void* data, std::size_t size) noexcept {
+    auto bytes = static_cast<const std::uint8_t*>(data);
+    total_size += size;
+    if (buffer_size > 0) {
+        const auto count = std::min(size, buffer.size() - buffer_size);
+        std::memcpy(buffer.data() + buffer_size, bytes, count);
+        buffer_size += count;
+        bytes += count;
+        size -= count;
+        if (buffer_size < buffer.size()) {
+            return;
+        }
+        compress(buffer.data());
+        buffer_size = 0;
+    }
+    for (; size >= buffer.size(); bytes += buffer.size(), size -= buffer.size()) {
+        compress(bytes);
+    }
+    std::memcpy(buffer.data(), bytes, size);
+    buffer_size = size;
+}
+
+
+Digest Sha256::digest() noexcept {
+    const std::uint64_t bit_size = total_size * 8;
+    // Pad with a single one bit and zeros until 8 bytes are left in the block, followed by the big-endian bit size
+    const std::uint8_t one = 0x80;
+    update(&one, 1);
+    const std::uint8_t zero = 0;
+    while (buffer_size != buffer.size() - 8) {
+        update(&zero, 1);
+    }
+    std::uint8_t size_bytes[8];
+    for (auto i = 0u; i < 8; ++i) {
+        size_bytes[i] = static_cast<std::uint8_t>(bit_size >> (56 - 8 * i));
+    }
+    update(size_bytes, 8);
+
+    Digest digest;
+    for (auto i = 0u; i < state.size(); ++i) {
+        for (auto j = 0u; j < 4; ++j) {
+            digest[4 * i + j] = static_cast<std::uint8_t>(state[i] >> (24 - 8 * j));
+        }
+    }
+    return digest;
+}
+
+
+void Sha256::compress(const std::uint8_t* block) noexcept {
+    std::uint32_t w[64];
+    for (auto i = 0u; i < 16; ++i) {
+        w[i] = static_cast<std::uint32_t>(block[4 * i]) << 24
+            | static_cast<std::uint32_t>(block[4 * i + 1]) << 16
+            | static_cast<std::uint32_t>(block[4 * i + 2]) << 8
+            | static_cast<std::uint32_t>(block[4 * i + 3]);
+    }
+    for (auto i = 16u; i < 64; ++i) {
+        const auto& s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const auto& s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    auto a = state[0], b = state[1], c = state[2], d = state[3];
+    auto e = state[4], f = state[5], g = state[6], h = state[7];
+    for (auto i = 0u; i < 64; ++i) {
+        const auto& s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+        const auto& choice = (e & f) ^ (~e & g);
+        const auto& t1 = h + s1 + choice + round_constants[i] + w[i];
+        const auto& s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+        const auto& majority = (a & b) ^ (a & c) ^ (b & c);
+        const auto& t2 = s0 + majority;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <unordered_set>
+#include "sketch.hpp"
+#include "window_fingerprints.hpp"
+
+
+// Seed for the hash function family, fixed to make signatures comparable between processes
+constexpr std::uint64_t minhash_seed = 0x9e3779b97f4a7c15ull;
+
+
+/*
+ * Multiply-shift hash functions h(x) = (a * x + b) >> 32, with odd multipliers a.
+ * The same family is returned for equal values of num_hashes.
+ */
+static std::vector<std::pair<std::uint64_t, std::uint64_t> > minhash_family(const std::size_t& num_hashes) {
+    std::mt19937_64 engine(minhash_seed);
+    std::vector<std::pair<std::uint64_t, std::uint64_t> > family;
+    family.reserve(num_hashes);
+    for (auto i = 0u; i < num_hashes; ++i) {
+        const auto a = engine() | 1u;
+        const auto b = engine();
+        family.emplace_back(a, b);
+    }
+    return family;
+}
+
+
+/*
+ * MinHash signature from the k-gram hashes of a string, skipping k-grams that contain marked tokens.
+ */
+static Signature fingerprints_signature(
+        const WindowFingerprints& fingerprints,
+        const std::string& marks,
+        const match_length_t& kgram_length,
+        const std::vector<std::pair<std::uint64_t, std::uint64_t> >& family) {
+
+    Signature signature;
+    if (fingerprints.empty()) {
+        return signature;
+    }
+    signature.assign(family.size(), std::numeric_limits<sketch_hash_t>::max());
+
+    // Position one past the last marked token seen so far,
+    // windows starting before it contain at least one mark
+    match_length_t unmarked_begin = 0;
+    bool has_kgrams = false;
+
+    const auto& token_count = fingerprints.size() + kgram_length - 1;
+    for (match_length_t i = 0; i < token_count; ++i) {
+        if (i < marks.size() and marks[i] == '1') {
+            unmarked_begin = i + 1;
+        }
+        if (i + 1 < kgram_length or i + 1 - kgram_length < unmarked_begin) {
+            // Incomplete window or window contains a marked token
+            continue;
+        }
+        has_kgrams = true;
+        const std::uint64_t kgram_hash = fingerprints[i + 1 - kgram_length];
+        for (auto h = 0u; h < family.size(); ++h) {
+            const auto value = static_cast<sketch_hash_t>((family[h].first * kgram_hash + family[h].second) >> 32);
+            signature[h] = std::min(signature[h], value);
+        }
+    }
+
+    if (not has_kgrams) {
+        signature.clear();
+    }
+    return signature;
+}
+
+
+Signature minhash_signature(
+        const std::string& tokens,
+        const std::string& marks,
+        const match_length_t& kgram_length,
+        const std::size_t& num_hashes) noexcept {
+    if (kgram_length == 0 or tokens.size() < kgram_length) {
+        return Signature();
+    }
+    return fingerprints_signature(window_fingerprints(tokens, kgram_length), marks, kgram_length, minhash_family(num_hashes));
+}
+
+
+double estimate_jaccard(const Signature& a, const Signature& b) noexcept {
+    if (a.empty() or a.size() != b.size()) {
+        return 0.0;
+    }
+    std::size_t equal_count = 0;
+    for (auto i = 0u; i < a.size(); ++i) {
+        equal_count += a[i] == b[i];
+    }
+    return static_cast<double>(equal_count) / a.size();
+}
+
+
+LSHIndex::LSHIndex(const std::size_t& bands, const std::size_t& rows) :
+    bands(bands),
+    rows(rows),
+    buckets(bands) {}
+
+
+std::size_t LSHIndex::insert(Signature signature) {
+    const auto index = signatures.size();
+    if (signature.size() == bands * rows) {
+        for (auto band = 0u; band < bands; ++band) {
+            // FNV-1a over the rows of this band
+            std::uint64_t band_hash = 0xcbf29ce484222325ull;
+            for (auto row = band * rows; row < (band + 1) * rows; ++row) {
+                band_hash = (band_hash ^ signature[row]) * 0x100000001b3ull;
+            }
+            buckets[band][band_hash].push_back(index);
+        }
+    } else {
+        // Strings without k-grams or with invalid signatures never become candidates
+        signature.clear();
+    }
+    signatures.push_back(std::move(signature));
+    return index;
+}
+
+
+CandidatePairs LSHIndex::candidate_pairs(const double& threshold) const {
+    // Collect unique index pairs as (a << 32 | b) keys.
+    // Near duplicates collide in most bands, so pairs are deduplicated while collecting to keep one key per pair
+    std::unordered_set<std::uint64_t> unique_keys;
+    for (const auto& band_buckets : buckets) {
+        for (const auto& bucket : band_buckets) {
+            const auto& indexes = bucket.second;
+            for (auto i = 0u; i < indexes.size(); ++i) {
+                for (auto j = i + 1; j < indexes.size(); ++j) {
+                    unique_keys.insert(static_cast<std::uint64_t>(indexes[i]) << 32 | indexes[j]);
+                }
+            }
+        }
+    }
+    std::vector<std::uint64_t> pair_keys(unique_keys.begin(), unique_keys.end());
+    unique_keys.clear();
+    std::sort(pair_keys.begin(), pair_keys.end());
+
+    CandidatePairs candidates;
+    for (const auto& key : pair_keys) {
+        const std::size_t a = key >> 32;
+        const std::size_t b = key & 0xffffffffu;
+        const auto similarity = estimate_jaccard(signatures[a], signatures[b]);
+        if (similarity >= threshold) {
+            candidates.push_back({ a, b, similarity });
+        }
+    }
+    return candidates;
+}
+
+
+CandidatePairs sketch_candidates(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const match_length_t& kgram_length,
+        const double& threshold,
+        const std::size_t& bands,
+        const std::size_t& rows) noexcept {
+    LSHIndex index(bands, rows);
+    const auto& family = minhash_family(bands * rows);
+    // The k-grams of all documents are hashed in one batch
+    const auto& fingerprints = batch_window_fingerprints(documents, kgram_length);
+    for (auto i = 0u; i < documents.size(); ++i) {
+        index.insert(fingerprints_signature(fingerprints[i], documents[i].second, kgram_length, family));
+    }
+    return index.candidate_pairs(threshold);
+}
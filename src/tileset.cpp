@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <iterator>
+#include "tileset.hpp"
+
+
+void TileSet::add(const Tile& tile) {
+    tiles.emplace(tile.pattern_index, tile);
+    cover(pattern_coverage, tile.pattern_index, tile.pattern_index + tile.match_length);
+    cover(text_coverage, tile.text_index, tile.text_index + tile.match_length);
+    tokens += tile.match_length;
+}
+
+
+bool TileSet::add_non_overlapping(const Tile& tile) {
+    if (overlaps(tile)) {
+        return false;
+    }
+    add(tile);
+    return true;
+}
+
+
+bool TileSet::overlaps(const Tile& tile) const noexcept {
+    return overlaps(pattern_coverage, tile.pattern_index, tile.pattern_index + tile.match_length)
+        or overlaps(text_coverage, tile.text_index, tile.text_index + tile.match_length);
+}
+
+
+void TileSet::extend(const TileSet& other) {
+    for (const auto& entry : other.tiles) {
+        add(entry.second);
+    }
+}
+
+
+void TileSet::clear() noexcept {
+    tiles.clear();
+    pattern_coverage.clear();
+    text_coverage.clear();
+    tokens = 0;
+}
+
+
+TileSet TileSet::reversed() const {
+    TileSet reversed_set;
+    for (const auto& entry : tiles) {
+        const auto& tile = entry.second;
+        reversed_set.tiles.emplace(tile.text_index, Tile{ tile.text_index, tile.pattern_index, tile.match_length });
+    }
+    reversed_set.pattern_coverage = text_coverage;
+    reversed_set.text_coverage = pattern_coverage;
+    reversed_set.tokens = tokens;
+    return reversed_set;
+}
+
+
+std::string TileSet::json() const {
+    std::string s = "[";
+    for (const auto& entry : tiles) {
+        const auto& tile = entry.second;
+        if (s.size() > 1) {
+            s += ',';
+        }
+        s += '[';
+        s += std::to_string(tile.pattern_index);
+        s += ',';
+        s += std::to_string(tile.text_index);
+        s += ',';
+        s += std::to_string(tile.match_length);
+        s += ']';
+    }
+    s += ']';
+    return s;
+}
+
+
+static void write_varint(std::string& bytes, match_length_t value) {
+    while (value >= 0x80u) {
+        bytes += static_cast<char>((value & 0x7fu) | 0x80u);
+        value >>= 7;
+    }
+    bytes += static_cast<char>(value);
+}
+
+
+static bool read_varint(const std::string& bytes, std::size_t& pos, match_length_t& value) noexcept {
+    value = 0;
+    for (unsigned shift = 0; pos < bytes.size() and shift < 64; shift += 7) {
+        const auto byte = static_cast<unsigned char>(bytes[pos++]);
+        value |= static_cast<match_length_t>(byte & 0x7fu) << shift;
+        if ((byte & 0x80u) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+std::string TileSet::to_bytes() const {
+    // Tile count, followed by the pattern index as a delta to the previous tile, the text index and the match length of each tile
+    std::string bytes;
+    write_varint(bytes, tiles.size());
+    match_length_t prev_pattern_index = 0;
+    for (const auto& entry : tiles) {
+        const auto& tile = entry.second;
+        write_varint(bytes, tile.pattern_index - prev_pattern_index);
+        write_varint(bytes, tile.text_index);
+        write_varint(bytes, tile.match_length);
+        prev_pattern_index = tile.pattern_index;
+    }
+    return bytes;
+}
+
+
+bool TileSet::from_bytes(const std::string& bytes, TileSet& tileset) {
+    tileset.clear();
+    std::size_t pos = 0;
+    match_length_t count;
+    if (not read_varint(bytes, pos, count)) {
+        return false;
+    }
+    match_length_t pattern_index = 0;
+    for (match_length_t i = 0; i < count; ++i) {
+        match_length_t pattern_delta, text_index, match_length;
+        if (not (read_varint(bytes, pos, pattern_delta)
+                 and read_varint(bytes, pos, text_index)
+                 and read_varint(bytes, pos, match_length))) {
+            tileset.clear();
+            return false;
+        }
+        pattern_index += pattern_delta;
+        tileset.add({ pattern_index, text_index, match_length });
+    }
+    if (pos != bytes.size()) {
+        tileset.clear();
+        return false;
+    }
+    return true;
+}
+
+
+TileSet TileSet::full_match(const match_length_t& length) {
+    TileSet tileset;
+    tileset.add({ 0, 0, length });
+    return tileset;
+}
+
+
+bool TileSet::overlaps(const Coverage& coverage, const match_length_t& begin, const match_length_t& end) noexcept {
+    if (begin >= end) {
+        return false;
+    }
+    // The only interval that can overlap [begin, end) is the last one that starts before end
+    auto it = coverage.lower_bound(end);
+    if (it == coverage.begin()) {
+        return false;
+    }
+    --it;
+    return it->second > begin;
+}
+
+
+void TileSet::cover(Coverage& coverage, match_length_t begin, match_length_t end) {
+    if (begin >= end) {
+        return;
+    }
+    // Merge all intervals that overlap or touch [begin, end) into one interval
+    auto it = coverage.upper_bound(begin);
+    if (it != coverage.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second >= begin) {
+            begin = prev->first;
+            end = std::max(end, prev->second);
+            it = prev;
+        }
+    }
+    while (it != coverage.end() and it->first <= end) {
+        end = std::max(end, it->second);
+        it = coverage.erase(it);
+    }
+    coverage.emplace(begin, end);
+}
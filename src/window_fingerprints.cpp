@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cstdint>
+#include "window_fingerprints.hpp"
+#include "cyclichash.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define GST_AVX2_FINGERPRINTS
+#include <immintrin.h>
+#endif
+
+
+/*
+ * Character hash values and rotations of the rolling hash of scanpatterns, which has 32-bit hash values.
+ * For every new character, the hash is rotated left by one and xored with the value of the new character,
+ * and the value of the character leaving the window, rotated left by window_length, is xored out.
+ */
+struct RollingHashTable {
+    explicit RollingHashTable(const match_length_t& window_length) noexcept :
+        out_rotation(window_length % 32) {
+        // Same hasher parameters as in scanpatterns
+        CyclicHash<match_length_t> hasher(window_length, 1u, 2u, 32u);
+        for (auto chr = 0u; chr < 256; ++chr) {
+            // The hash of a single character is its hash value
+            hasher.reset();
+            hasher.eat(static_cast<unsigned char>(chr));
+            values[chr] = static_cast<std::uint32_t>(hasher.hashvalue);
+        }
+    }
+
+    std::uint32_t values[256];
+    const unsigned out_rotation;
+};
+
+
+inline std::uint32_t rotate_left(const std::uint32_t& x, const unsigned& r) noexcept {
+    return (x << r) | (x >> ((32 - r) & 31));
+}
+
+
+/*
+ * Advance the rolling hashes of fingerprint_lanes strings over length steps.
+ * values contains the character hash values of step i of all lanes at i * fingerprint_lanes, and zeros after the end of a string.
+ * The hash of the window ending at step i of each lane is written to hashes at (i + 1 - window_length) * fingerprint_lanes.
+ */
+static void advance_lanes(const std::uint32_t* values, const std::size_t& length, const match_length_t& window_length,
+        const unsigned& out_rotation, std::uint32_t* hashes) noexcept {
+    std::uint32_t lane_hashes[fingerprint_lanes] = {};
+    for (std::size_t i = 0; i < length; ++i) {
+        const auto* in = values + i * fingerprint_lanes;
+        for (auto lane = 0u; lane < fingerprint_lanes; ++lane) {
+            lane_hashes[lane] = rotate_left(lane_hashes[lane], 1) ^ in[lane];
+        }
+        if (i >= window_length) {
+            const auto* out = values + (i - window_length) * fingerprint_lanes;
+            for (auto lane = 0u; lane < fingerprint_lanes; ++lane) {
+                lane_hashes[lane] ^= rotate_left(out[lane], out_rotation);
+            }
+        }
+        if (i + 1 >= window_length) {
+            std::copy(lane_hashes, lane_hashes + fingerprint_lanes, hashes + (i + 1 - window_length) * fingerprint_lanes);
+        }
+    }
+}
+
+
+#ifdef GST_AVX2_FINGERPRINTS
+// advance_lanes with one lane in each 32-bit element of an AVX2 register
+__attribute__((target("avx2")))
+static void advance_lanes_avx2(const std::uint32_t* values, const std::size_t& length, const match_length_t& window_length,
+        const unsigned& out_rotation, std::uint32_t* hashes) noexcept {
+    static_assert(fingerprint_lanes == 8, "fingerprint lanes must fill an AVX2 register");
+    const __m128i out_left = _mm_cvtsi32_si128(static_cast<int>(out_rotation));
+    const __m128i out_right = _mm_cvtsi32_si128(static_cast<int>(32 - out_rotation));
+    __m256i lane_hashes = _mm256_setzero_si256();
+    for (std::size_t i = 0; i < length; ++i) {
+        const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i * fingerprint_lanes));
+        lane_hashes = _mm256_or_si256(_mm256_slli_epi32(lane_hashes, 1), _mm256_srli_epi32(lane_hashes, 31));
+        lane_hashes = _mm256_xor_si256(lane_hashes, in);
+        if (i >= window_length) {
+            const __m256i out = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + (i - window_length) * fingerprint_lanes));
+            // Shifting right by 32 gives zero, so a rotation by 0 leaves out unchanged
+            lane_hashes = _mm256_xor_si256(lane_hashes, _mm256_or_si256(_mm256_sll_epi32(out, out_left), _mm256_srl_epi32(out, out_right)));
+        }
+        if (i + 1 >= window_length) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(hashes + (i + 1 - window_length) * fingerprint_lanes), lane_hashes);
+        }
+    }
+}
+#endif
+
+
+WindowFingerprints window_fingerprints(const std::string& str, const match_length_t& window_length) noexcept {
+    WindowFingerprints fingerprints;
+    if (window_length == 0 or str.size() < window_length) {
+        return fingerprints;
+    }
+    fingerprints.reserve(str.size() - window_length + 1);
+    // Same hasher parameters as in scanpatterns
+    CyclicHash<match_length_t> hasher(window_length, 1u, 2u, 32u);
+    for (auto i = 0u; i < str.size(); ++i) {
+        if (i < window_length) {
+            hasher.eat(str[i]);
+        } else {
+            hasher.update(str[i - window_length], str[i]);
+        }
+        if (i + 1 >= window_length) {
+            fingerprints.push_back(static_cast<std::uint32_t>(hasher.hashvalue));
+        }
+    }
+    return fingerprints;
+}
+
+
+std::vector<WindowFingerprints> batch_window_fingerprints(
+        const std::vector<std::pair<std::string, std::string> >& documents,
+        const match_length_t& window_length,
+        const FingerprintLanes& lanes) noexcept {
+    std::vector<WindowFingerprints> fingerprints(documents.size());
+    if (window_length == 0) {
+        return fingerprints;
+    }
+
+    // Group documents of similar length, longest first, so that few lanes of a group are idle after the end of their document
+    std::vector<std::size_t> order;
+    for (auto i = 0u; i < documents.size(); ++i) {
+        if (documents[i].first.size() >= window_length) {
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&documents](const std::size_t& a, const std::size_t& b) {
+        return documents[a].first.size() > documents[b].first.size();
+    });
+
+    auto advance = advance_lanes;
+#ifdef GST_AVX2_FINGERPRINTS
+    if (lanes == FingerprintLanes::automatic and __builtin_cpu_supports("avx2")) {
+        advance = advance_lanes_avx2;
+    }
+#endif
+
+    const RollingHashTable table(window_length);
+    std::vector<std::uint32_t> values;
+    std::vector<std::uint32_t> hashes;
+    for (auto group_begin = 0u; group_begin < order.size(); group_begin += fingerprint_lanes) {
+        const auto group_size = std::min(fingerprint_lanes, order.size() - group_begin);
+        const auto& group_length = documents[order[group_begin]].first.size();
+
+        // Interleave the character hash values of the documents of the group
+        values.assign(group_length * fingerprint_lanes, 0u);
+        for (auto lane = 0u; lane < group_size; ++lane) {
+            const auto& str = documents[order[group_begin + lane]].first;
+            for (auto i = 0u; i < str.size(); ++i) {
+                values[i * fingerprint_lanes + lane] = table.values[static_cast<unsigned char>(str[i])];
+            }
+        }
+
+        hashes.resize((group_length - window_length + 1) * fingerprint_lanes);
+        advance(values.data(), group_length, window_length, table.out_rotation, hashes.data());
+
+        for (auto lane = 0u; lane < group_size; ++lane) {
+            auto& document_fingerprints = fingerprints[order[group_begin + lane]];
+            document_fingerprints.resize(documents[order[group_begin + lane]].first.size() - window_length + 1);
+            for (auto i = 0u; i < document_fingerprints.size(); ++i) {
+                document_fingerprints[i] = hashes[i * fingerprint_lanes + lane];
+            }
+        }
+    }
+    return fingerprints;
+}
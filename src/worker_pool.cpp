@@ -0,0 +1,70 @@
+#include "worker_pool.hpp"
+#include <iterator>
+
+
+WorkerPool::WorkerPool(std::size_t thread_count) :
+    thread_count(thread_count > 0 ? thread_count : 1) {
+    workers.reserve(this->thread_count);
+    for (auto i = 0u; i < this->thread_count; ++i) {
+        workers.emplace_back(&WorkerPool::work, this);
+    }
+}
+
+
+WorkerPool::~WorkerPool() {
+    for (auto& task : shutdown(false)) {
+        task(true);
+    }
+}
+
+
+bool WorkerPool::submit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        if (stopping) {
+            return false;
+        }
+        tasks.push_back(std::move(task));
+    }
+    tasks_available.notify_one();
+    return true;
+}
+
+
+std::vector<WorkerPool::Task> WorkerPool::shutdown(bool run_pending) {
+    std::vector<Task> dropped_tasks;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        if (stopping) {
+            return dropped_tasks;
+        }
+        stopping = true;
+        drain = run_pending;
+        if (not run_pending) {
+            dropped_tasks.assign(std::make_move_iterator(tasks.begin()), std::make_move_iterator(tasks.end()));
+            tasks.clear();
+        }
+    }
+    tasks_available.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return dropped_tasks;
+}
+
+
+void WorkerPool::work() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(tasks_mutex);
+            tasks_available.wait(lock, [this] { return stopping or not tasks.empty(); });
+            if (tasks.empty() or (stopping and not drain)) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task(false);
+    }
+}
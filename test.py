@@ -1,8 +1,15 @@
+import asyncio
 import unittest
-import importlib
+import importlib.util
+import os
+import random
 import string
+import tempfile
+import threading
 
 import gst
+from matchlib import matcher
+from matchlib.util import TokenMatch, TokenMatchSet
 
 from hypothesis import strategies, settings, given
 
@@ -82,6 +89,366 @@ class Test2EdgeCases(TestCase):
             self.assertGreater(len(matches), 0)
 
 
+class Test2SketchCandidates(TestCase):
+
+    def test1_identical_documents_are_candidates(self):
+        text = string.ascii_letters * 4
+        candidates = gst.sketch_candidates([(text, ''), (string.digits * 20, ''), (text, '')], 5, 0.9)
+        self.assertEqual(candidates, [(0, 2, 1.0)])
+
+    def test2_marked_documents_are_not_candidates(self):
+        text = string.ascii_letters
+        marks = '1' * len(text)
+        candidates = gst.sketch_candidates([(text, marks), (text, marks)], 5, 0.0)
+        self.assertEqual(candidates, [])
+
+    def test3_invalid_documents(self):
+        with self.assertRaises(gst.MatchError):
+            gst.sketch_candidates([("abc",)], 2, 0.5)
+
+
+class Test2GroupDuplicates(TestCase):
+
+    def test1_exact_duplicates(self):
+        documents = [("abc", ""), ("xyz", ""), ("abc", "000"), ("abc", "001")]
+        self.assertEqual(gst.group_duplicates(documents), [[0, 2], [1], [3]])
+
+    def test2_duplicates_ignoring_marked(self):
+        documents = [("abc", "001"), ("abd", "001"), ("abd", "")]
+        self.assertEqual(gst.group_duplicates(documents, True), [[0, 1], [2]])
+
+
+class Test2MatchOneToMany(TestCase):
+
+    def test1_equal_to_match(self):
+        query = "abcdefghij" * 5
+        query_marks = "0" * 10 + "1" + "0" * 39
+        documents = [("xx" + "abcdefghij" * i, "") for i in range(1, 8)] + [("abcdefghij" * 5, "01" * 25), ("ab", "")]
+        tiles = gst.match_one_to_many(query, query_marks, documents, 3)
+        self.assertEqual(tiles, [gst.match(query, query_marks, tokens, marks, 3) for tokens, marks in documents])
+
+    def test2_shorter_as_pattern(self):
+        query = "abcdefghij" * 3
+        documents = [("xxabcdefghij", ""), ("abcdefghij" * 4, "")]
+        tiles = gst.match_one_to_many(query, "", documents, 3, True)
+        self.assertEqual(tiles[0], [(j, i, n) for i, j, n in gst.match("xxabcdefghij", "", query, "", 3)])
+        self.assertEqual(tiles[1], gst.match(query, "", "abcdefghij" * 4, "", 3))
+
+    def test3_invalid_arguments(self):
+        with self.assertRaises(gst.MatchError):
+            gst.match_one_to_many(1, "", [], 3)
+        with self.assertRaises(gst.MatchError):
+            gst.match_one_to_many("abc", "", [("abc",)], 3)
+
+
+class Test2MatchAllPairs(TestCase):
+
+    def test1_equal_to_match(self):
+        documents = [("abcdefgh" * i, "0" * 8 * i) for i in range(1, 6)] + [("xxabcdefghxx" * 2, ""), ("ab", "")]
+        for block_size in (0, 100, 1 << 20):
+            pairs = gst.match_all_pairs(documents, 3, block_size)
+            self.assertEqual([(a, b) for a, b, _ in pairs], [(a, b) for a in range(len(documents)) for b in range(a + 1, len(documents))])
+            for a, b, tiles in pairs:
+                (tokens_a, marks_a), (tokens_b, marks_b) = documents[a], documents[b]
+                if len(tokens_b) < len(tokens_a):
+                    expected = [(i, j, n) for j, i, n in gst.match(tokens_b, marks_b, tokens_a, marks_a, 3)]
+                else:
+                    expected = gst.match(tokens_a, marks_a, tokens_b, marks_b, 3)
+                self.assertEqual(tiles, expected)
+
+    def test2_result_cache(self):
+        documents = [("abcdefgh" * i, "") for i in range(1, 6)]
+        with tempfile.TemporaryDirectory() as directory:
+            cache = gst.ResultCache(os.path.join(directory, "results"))
+            pairs = gst.match_all_pairs(documents, 3, 0, cache)
+            self.assertEqual(len(cache), len(pairs))
+            self.assertEqual(gst.match_all_pairs(documents, 3, 0, cache), pairs)
+
+    def test3_invalid_arguments(self):
+        with self.assertRaises(gst.MatchError):
+            gst.match_all_pairs([("abc", "")], 3, -1)
+        with self.assertRaises(gst.MatchError):
+            gst.match_all_pairs([("abc", "")], 3, 0, "cache")
+        self.assertEqual(gst.match_all_pairs([], 3), [])
+        with self.assertRaises(gst.MatchError):
+            gst.match_all_pairs([("abc", ""), ("abc", "")], 3, 0, None, 0.5, [1])
+        with self.assertRaises(gst.MatchError):
+            gst.match_all_pairs([("abc", "")], 3, 0, None, "0.5")
+
+    def test4_minimum_similarity(self):
+        documents = [("abcdefgh" * i, "0" * 8 * i) for i in range(1, 6)] + [("xxabcdefghxx" * 2, "1" * 12), ("ab", "")]
+        pairs = gst.match_all_pairs(documents, 3)
+        for weights in (None, [len(tokens) for tokens, _ in documents]):
+            weight = weights or [len(tokens) - marks.count("1") for tokens, marks in documents]
+            for minimum_similarity in (-1, 0, 0.5, 1):
+                expected = [(a, b, tiles) for a, b, tiles in pairs
+                            if sum(n for _, _, n in tiles) / ((weight[a] + weight[b]) / 2) > minimum_similarity]
+                self.assertEqual(gst.match_all_pairs(documents, 3, 100, None, minimum_similarity, weights), expected)
+
+    def test5_iter(self):
+        documents = [("abcdefgh" * i, "0" * 8 * i) for i in range(1, 6)] + [("xxabcdefghxx" * 2, "1" * 12), ("ab", "")]
+        for args in ((0,), (100,), (100, None, 0.5)):
+            pairs = gst.match_all_pairs_iter(documents, 3, *args)
+            self.assertEqual(next(pairs), gst.match_all_pairs(documents, 3, *args)[0])
+            self.assertEqual(list(pairs), gst.match_all_pairs(documents, 3, *args)[1:])
+        self.assertEqual(list(gst.match_all_pairs_iter([], 3)), [])
+        with self.assertRaises(gst.MatchError):
+            gst.match_all_pairs_iter([("abc", "")], 3, -1)
+
+
+class Test2MatchIter(TestCase):
+
+    def test1_same_tiles_as_match(self):
+        pattern = "abcdefghij" * 3 + "0123"
+        text = "xx" + "abcdefghij" * 2 + "yy" + "abcdef" + "0123"
+        tiles = list(gst.match_iter(pattern, "", text, "", 2))
+        self.assertEqual(sorted(tiles), sorted(gst.match(pattern, "", text, "", 2)))
+        self.assertEqual(tiles[0], (0, 2, 20))
+
+    def test2_early_stop(self):
+        tiles = gst.match_iter("abcdefghij" * 100, "", "abcdefghij" * 100, "", 2)
+        self.assertEqual(next(tiles), (0, 0, 1000))
+        self.assertEqual(list(tiles), [])
+        self.assertEqual(list(gst.match_iter("abc", "", "abc", "", 5)), [])
+
+
+class Test2MatchAsync(TestCase):
+
+    def test1_equal_to_match(self):
+        args = [("abcdefgh" * i, "0" * 8 * i, "xxabcdefghxx" * i, "0" * 12 * i, 3) for i in range(1, 50)]
+        async def match_all():
+            return await asyncio.gather(*(gst.match_async(*a) for a in args))
+        gst.set_pool_size(3)
+        try:
+            self.assertEqual(asyncio.run(match_all()), [gst.match(*a) for a in args])
+        finally:
+            gst.set_pool_size(0)
+
+    def test2_cancelled(self):
+        async def cancel():
+            futures = [gst.match_async("a" * 10000, "0" * 10000, "a" * 10000, "0" * 10000, 1) for _ in range(10)]
+            for future in futures:
+                future.cancel()
+            with self.assertRaises(asyncio.CancelledError):
+                await futures[-1]
+        asyncio.run(cancel())
+
+    def test3_no_running_loop(self):
+        with self.assertRaises(RuntimeError):
+            gst.match_async("a", "0", "a", "0", 1)
+
+
+class Test2ResultCache(TestCase):
+
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+        self.path = os.path.join(self.directory.name, "results")
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def test1_equal_to_match(self):
+        args = [("abcdefgh" * i, "0" * 8 * i, "xxabcdefghxx" * i, "0" * 12 * i, 3) for i in range(1, 20)]
+        cache = gst.ResultCache(self.path)
+        self.assertIsNone(cache.get(*args[0]))
+        self.assertEqual([cache.match(*a) for a in args], [gst.match(*a) for a in args])
+        self.assertEqual(len(cache), len(args))
+        self.assertEqual(cache.get(*args[0]), gst.match(*args[0]))
+
+    def test2_shared_file(self):
+        args = ("abcdefgh", "", "xxabcdefghxx", "", 3)
+        gst.ResultCache(self.path).match(*args)
+        other = gst.ResultCache(self.path)
+        self.assertEqual(other.get(*args), gst.match(*args))
+        # Missing marks are equal to unmarked tokens
+        self.assertEqual(other.get("abcdefgh", "00000000", "xxabcdefghxx", "0", 3), gst.match(*args))
+        self.assertIsNone(other.get("abcdefgh", "1", "xxabcdefghxx", "", 3))
+        self.assertIsNone(other.get(*args[:-1], 4))
+
+    def test3_invalid_file(self):
+        with open(self.path, "w") as f:
+            f.write("not a cache")
+        with self.assertRaises(ValueError):
+            gst.ResultCache(self.path)
+        with self.assertRaises(OSError):
+            gst.ResultCache(os.path.join(self.path, "results"))
+        with self.assertRaises(gst.MatchError):
+            gst.ResultCache(self.path + "2").match("a", "", "a", "", None)
+
+
+class Test2Interpreters(TestCase):
+
+    def test1_keyword_arguments(self):
+        self.assertEqual(
+            gst.match("lower", "", text="yellow", text_marks="", minimum_match_length=2),
+            gst.match("lower", "", "yellow", "", 2))
+        for kwargs in ({"pattern": "lower"}, {"unknown": 1}):
+            with self.assertRaises(gst.MatchError):
+                gst.match("lower", "", "yellow", "", 2, **kwargs)
+        # As before keyword arguments were supported, negative lengths match nothing and read-only buffers are strings
+        self.assertEqual(gst.match("lower", "", "yellow", "", -1), [])
+        class Tokens(bytes):
+            pass
+        self.assertEqual(gst.match(Tokens(b"lower"), "", "yellow", "", 2), gst.match("lower", "", "yellow", "", 2))
+        for invalid in (bytearray(b"lower"), memoryview(b"lower"), 1):
+            with self.assertRaises(gst.MatchError):
+                gst.match(invalid, "", "yellow", "", 2)
+
+    def test2_parallel_threads(self):
+        text = "abcde" * 5000
+        expected = gst.match(text, "", text[::-1], "", 3)
+        results = [None] * 4
+        def match(i):
+            results[i] = gst.match(text, "", text[::-1], "", 3)
+        threads = [threading.Thread(target=match, args=(i,)) for i in range(len(results))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(results, [expected] * len(results))
+
+    @unittest.skipUnless(importlib.util.find_spec("_xxsubinterpreters"), "requires sub-interpreters")
+    def test3_sub_interpreter(self):
+        import _xxsubinterpreters as interpreters
+        interpreter = interpreters.create()
+        try:
+            interpreters.run_string(interpreter, "\n".join((
+                "import gst",
+                "assert gst.match('lower', '', 'yellow', '', 2) == [(0, 3, 3)]",
+                "assert gst.TileSet([(0, 3, 3)]).all() == [(0, 3, 3)]",
+            )))
+        finally:
+            interpreters.destroy(interpreter)
+        self.assertEqual(gst.TileSet([(0, 3, 3)]).all(), [(0, 3, 3)])
+
+
+class Test2TileSet(TestCase):
+
+    def test1_sorted_and_counted(self):
+        tiles = gst.TileSet([(5, 1, 2), (0, 10, 3)])
+        self.assertEqual(tiles.all(), [(0, 10, 3), (5, 1, 2)])
+        self.assertEqual(tiles.token_count(), 5)
+        self.assertEqual(tiles.json(), "[[0,10,3],[5,1,2]]")
+
+    def test2_non_overlapping(self):
+        tiles = gst.TileSet.full_match_from_length(10)
+        self.assertFalse(tiles.add_non_overlapping(9, 20, 5))
+        self.assertFalse(tiles.add_non_overlapping(20, 9, 5))
+        self.assertTrue(tiles.add_non_overlapping(10, 10, 5))
+        self.assertEqual(len(tiles), 2)
+
+    def test3_reverse_and_bytes(self):
+        tiles = gst.TileSet([(0, 10, 3), (5, 1, 2)])
+        self.assertEqual(tiles.reverse().all(), [(1, 5, 2), (10, 0, 3)])
+        self.assertEqual(gst.TileSet.from_bytes(tiles.to_bytes()).all(), tiles.all())
+        with self.assertRaises(gst.MatchError):
+            gst.TileSet.from_bytes(tiles.to_bytes()[:-1])
+
+
+class Test2TokenMatchSet(TestCase):
+
+    def test1_insertion_order(self):
+        matches = TokenMatchSet([(5, 1, 2)])
+        matches.add(TokenMatch(0, 10, 3))
+        self.assertFalse(matches.add_non_overlapping(TokenMatch(6, 20, 1)))
+        self.assertTrue(matches.add_non_overlapping(TokenMatch(7, 20, 1)))
+        self.assertEqual([(m.a, m.b, m.length) for m in matches.all()], [(5, 1, 2), (0, 10, 3), (7, 20, 1)])
+        self.assertEqual(matches.json(), "[[0,10,3],[5,1,2],[7,20,1]]")
+        self.assertEqual(matches.reverse().json(), "[[1,5,2],[10,0,3],[20,7,1]]")
+
+    def test2_store(self):
+        matches = TokenMatchSet()
+        matches.store = [TokenMatch(5, 1, 2), TokenMatch(0, 10, 3)]
+        matches.store.append(TokenMatch(7, 20, 1))
+        self.assertFalse(matches.add_non_overlapping(TokenMatch(6, 20, 1)))
+        self.assertEqual(matches.token_count(), 6)
+        self.assertEqual(matches.json(), "[[0,10,3],[5,1,2],[7,20,1]]")
+        self.assertEqual(matches.reverse().json(), "[[1,5,2],[10,0,3],[20,7,1]]")
+        matches.clear()
+        self.assertEqual(matches.match_count(), 0)
+
+
+class Test2MatchlibDuplicates(TestCase):
+
+    @staticmethod
+    def string_data(tokens, marks=""):
+        unmarked = len(tokens) - marks.count("1")
+        return {"tokens": tokens, "ignore_marks": marks or "0" * len(tokens), "authored_token_count": unmarked, "longest_authored_tile": unmarked}
+
+    def setUp(self):
+        copied, other = "abcdefghij" * 3, "xyzxyzxyzq" * 2
+        documents = [
+            self.string_data(copied),
+            self.string_data(other),
+            self.string_data(copied),
+            self.string_data("abcdefghij" * 2 + "klmnopqrst"),
+            self.string_data(other),
+            self.string_data(copied, "0" * 20 + "1" * 10),
+            self.string_data("abcdefghij" * 2 + "QQQQQQQQQQ", "0" * 20 + "1" * 10),
+        ]
+        self.documents = [dict(d, id=i) for i, d in enumerate(documents)]
+        self.ungrouped = list(matcher.match_all_combinations({"minimum_match_length": 3, "group_duplicates": False}, self.documents))
+
+    def test1_same_pairs_as_ungrouped(self):
+        for config in ({}, {"group_ignored_duplicates": True}):
+            results = list(matcher.match_all_combinations(dict(config, minimum_match_length=3), self.documents))
+            self.assertEqual([r[:2] for r in results], [r[:2] for r in self.ungrouped])
+            self.assertEqual([r[3] for r in results], [r[3] for r in self.ungrouped])
+        # Sketching skips some pairs, the others come in input order
+        results = list(matcher.match_all_combinations({"minimum_match_length": 3, "sketch_threshold": 0.1}, self.documents))
+        self.assertEqual([r[:2] for r in results], sorted(r[:2] for r in results))
+        similarities = {(r[0], r[1]): r[3] for r in self.ungrouped}
+        for r in results:
+            self.assertEqual(r[3], similarities[r[0], r[1]])
+
+    def test2_duplicates_ignoring_marked_are_not_full_matches(self):
+        results = matcher.match_all_combinations({"minimum_match_length": 3, "group_ignored_duplicates": True}, self.documents)
+        tiles = {(r[0], r[1]): r[2] for r in results}
+        self.assertEqual(tiles[5, 6], "[[0,0,20]]")
+        self.assertEqual(tiles[0, 2], "[[0,0,30]]")
+
+    def test3_minimum_similarity_keeps_pairs_of_ungrouped(self):
+        for minimum_similarity in (0, 0.5, 0.7, 0.99):
+            expected = [r for r in self.ungrouped if r[3] > minimum_similarity]
+            for config in ({}, {"group_ignored_duplicates": True}, {"group_duplicates": False}):
+                results = list(matcher.match_all_combinations(
+                    dict(config, minimum_match_length=3, minimum_similarity=minimum_similarity), self.documents))
+                self.assertEqual(results, expected)
+
+    def test4_equal_lengths_same_as_ungrouped(self):
+        # Greedy string tiling is not symmetric, the first of two equally long documents is the pattern
+        rng = random.Random(1)
+        texts = ["".join(rng.choice("abcd") for _ in range(60)) for _ in range(8)]
+        documents = [self.string_data(texts[rng.randrange(len(texts))]) for _ in range(30)]
+        documents = [dict(d, id=i) for i, d in enumerate(documents)]
+        ungrouped = list(matcher.match_all_combinations({"minimum_match_length": 3, "group_duplicates": False}, documents))
+        for config in ({}, {"minimum_similarity": 0.5}):
+            expected = [r for r in ungrouped if r[3] > config.get("minimum_similarity", -1)]
+            self.assertEqual(list(matcher.match_all_combinations(dict(config, minimum_match_length=3), documents)), expected)
+
+    def test5_pairs_taken_as_needed(self):
+        taken = []
+        all_pairs = matcher.all_pairs_greedy_string_tiling
+        def tracked_all_pairs(*args):
+            for pair, matches in all_pairs(*args):
+                taken.append(pair)
+                yield pair, matches
+        matcher.all_pairs_greedy_string_tiling = tracked_all_pairs
+        try:
+            results = matcher.match_all_combinations({"minimum_match_length": 3, "all_pairs_block_size": 0}, self.documents)
+            self.assertEqual(next(results)[:2], [0, 1])
+            # Of the 10 pairs of the 5 classes, only the 4 of the first row and the next one have been taken
+            self.assertEqual(len(taken), 5)
+            self.assertEqual([next(results)] + list(results), self.ungrouped[1:])
+        finally:
+            matcher.all_pairs_greedy_string_tiling = all_pairs
+
+    def test6_match_to_others_in_input_order(self):
+        results = list(matcher.match_to_others({"minimum_match_length": 3}, self.documents[2], self.documents[:2] + self.documents[3:]))
+        self.assertEqual([r[1] for r in results], [0, 1, 3, 4, 5, 6])
+        self.assertTrue(all(r[0] == 2 for r in results))
+
+
 @strategies.composite
 def tuples_of_text_and_substring(draw, text_min_size=0, text_max_size=100, alphabet=string.printable):
     text = draw(strategies.text(
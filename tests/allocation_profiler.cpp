@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+#include "profiling.hpp"
+
+// Allocations are prefixed with a header containing their size, keeping the returned pointers maximally aligned
+constexpr std::size_t header_size = alignof(std::max_align_t);
+
+constexpr auto phase_count = static_cast<unsigned>(ProfilingPhase::count);
+
+static std::atomic<unsigned> current_phase(static_cast<unsigned>(ProfilingPhase::other));
+static std::atomic<std::size_t> live_bytes(0);
+static std::atomic<std::size_t> live_bytes_at_reset(0);
+static std::atomic<std::size_t> phase_allocations[phase_count];
+static std::atomic<std::size_t> phase_bytes[phase_count];
+static std::atomic<std::size_t> phase_peak_live_bytes[phase_count];
+
+
+static void record_allocation(std::size_t size) noexcept {
+    const auto phase = current_phase.load(std::memory_order_relaxed);
+    phase_allocations[phase].fetch_add(1, std::memory_order_relaxed);
+    phase_bytes[phase].fetch_add(size, std::memory_order_relaxed);
+    const auto live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    const auto at_reset = live_bytes_at_reset.load(std::memory_order_relaxed);
+    const auto live_since_reset = live > at_reset ? live - at_reset : 0;
+    auto peak = phase_peak_live_bytes[phase].load(std::memory_order_relaxed);
+    while (live_since_reset > peak
+           and not phase_peak_live_bytes[phase].compare_exchange_weak(peak, live_since_reset, std::memory_order_relaxed)) {
+    }
+}
+
+
+static void* counting_allocate(std::size_t size) noexcept {
+    auto* block = static_cast<char*>(std::malloc(size + header_size));
+    if (block == nullptr) {
+        return nullptr;
+    }
+    *reinterpret_cast<std::size_t*>(block) = size;
+    record_allocation(size);
+    return block + header_size;
+}
+
+
+static void counting_free(void* ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto* block = static_cast<char*>(ptr) - header_size;
+    live_bytes.fetch_sub(*reinterpret_cast<std::size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+
+void* operator new(std::size_t size) {
+    void* ptr = counting_allocate(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counting_allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counting_allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    counting_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    counting_free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    counting_free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    counting_free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    counting_free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    counting_free(ptr);
+}
+
+
+void profiling_enter_phase(ProfilingPhase phase) noexcept {
+    current_phase.store(static_cast<unsigned>(phase), std::memory_order_relaxed);
+}
+
+
+void profiling_reset() noexcept {
+    for (auto phase = 0u; phase < phase_count; ++phase) {
+        phase_allocations[phase].store(0, std::memory_order_relaxed);
+        phase_bytes[phase].store(0, std::memory_order_relaxed);
+        phase_peak_live_bytes[phase].store(0, std::memory_order_relaxed);
+    }
+    live_bytes_at_reset.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    profiling_enter_phase(ProfilingPhase::other);
+}
+
+
+AllocationStats profiling_phase(ProfilingPhase phase) noexcept {
+    const auto i = static_cast<unsigned>(phase);
+    AllocationStats stats;
+    stats.allocations = phase_allocations[i].load(std::memory_order_relaxed);
+    stats.bytes = phase_bytes[i].load(std::memory_order_relaxed);
+    stats.peak_live_bytes = phase_peak_live_bytes[i].load(std::memory_order_relaxed);
+    return stats;
+}
+
+
+AllocationStats profiling_total() noexcept {
+    AllocationStats total;
+    for (auto i = 0u; i < phase_count; ++i) {
+        const auto& stats = profiling_phase(static_cast<ProfilingPhase>(i));
+        total.allocations += stats.allocations;
+        total.bytes += stats.bytes;
+        total.peak_live_bytes = std::max(total.peak_live_bytes, stats.peak_live_bytes);
+    }
+    return total;
+}
+
+
+bool profiling_reset_peak_rss() noexcept {
+    // Writing 5 to clear_refs resets the VmHWM of the process to its current resident set size, since Linux 4.0
+    std::FILE* clear_refs = std::fopen("/proc/self/clear_refs", "w");
+    if (clear_refs == nullptr) {
+        return false;
+    }
+    const bool written = std::fputs("5", clear_refs) >= 0;
+    return std::fclose(clear_refs) == 0 and written;
+}
+
+
+std::size_t profiling_peak_rss_kb() noexcept {
+    // VmHWM is reset by profiling_reset_peak_rss, unlike ru_maxrss
+    std::FILE* status = std::fopen("/proc/self/status", "r");
+    if (status != nullptr) {
+        char line[256];
+        unsigned long peak_kb = 0;
+        bool found = false;
+        while (not found and std::fgets(line, sizeof(line), status) != nullptr) {
+            found = std::sscanf(line, "VmHWM: %lu kB", &peak_kb) == 1;
+        }
+        std::fclose(status);
+        if (found) {
+            return peak_kb;
+        }
+    }
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    // Linux reports ru_maxrss in kilobytes
+    return static_cast<std::size_t>(usage.ru_maxrss);
+}
@@ -0,0 +1,162 @@
+#include "all_pairs.hpp"
+#include "data_generator.hpp"
+#include "catch.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+
+// Tiles of a pair as matchlib computes them, with the shorter document as the pattern
+static Tiles expected_pair_tiles(const std::pair<std::string, std::string>& a, const std::pair<std::string, std::string>& b, const match_length_t& init_search_length) {
+    if (b.first.size() >= a.first.size()) {
+        return match_strings(a.first, b.first, init_search_length, a.second, b.second);
+    }
+    Tiles reversed;
+    for (const auto& tile : match_strings(b.first, a.first, init_search_length, b.second, a.second)) {
+        reversed.push_back({ tile.text_index, tile.pattern_index, tile.match_length });
+    }
+    return reversed;
+}
+
+
+static void require_expected_tiles(const std::vector<std::pair<std::string, std::string> >& documents, const AllPairsTiles& all_pairs_tiles, const match_length_t& init_search_length) {
+    REQUIRE(all_pairs_tiles.size() == documents.size() * (documents.size() - 1) / 2);
+    auto pair_it = all_pairs_tiles.begin();
+    for (auto a = 0u; a < documents.size(); ++a) {
+        for (auto b = a + 1; b < documents.size(); ++b, ++pair_it) {
+            REQUIRE(pair_it->a == a);
+            REQUIRE(pair_it->b == b);
+            const auto& expected = expected_pair_tiles(documents[a], documents[b], init_search_length);
+            REQUIRE(pair_it->tiles.size() == expected.size());
+            for (auto i = 0u; i < expected.size(); ++i) {
+                REQUIRE(pair_it->tiles[i].pattern_index == expected[i].pattern_index);
+                REQUIRE(pair_it->tiles[i].text_index == expected[i].text_index);
+                REQUIRE(pair_it->tiles[i].match_length == expected[i].match_length);
+            }
+        }
+    }
+}
+
+
+SCENARIO("All-pairs matching gives the tiles of matching each pair", "[all-pairs]") {
+    CAPTURE(data_generator_seed());
+
+    constexpr auto init_search_length = 5lu;
+
+    GIVEN("Random copies of a random string with different lengths and marks") {
+        const auto& base = next_string(300);
+        std::vector<std::pair<std::string, std::string> > documents;
+        for (auto i = 0u; i < 20; ++i) {
+            const auto& tokens = random_string_copy(base, 0.8f).substr(0, 100 + next_integer(0, 200));
+            documents.emplace_back(tokens, next_bitstring(tokens.size(), 0.02));
+        }
+        documents.emplace_back("abc", "");
+
+        WHEN("Matching with blocks of different sizes and both hashing modes") {
+            THEN("Every pair has the tiles of matching it alone") {
+                for (const auto& block_size : { 0lu, 1000lu, default_all_pairs_block_size }) {
+                    CAPTURE(block_size);
+                    require_expected_tiles(documents, match_all_pairs(documents, init_search_length, block_size), init_search_length);
+                    require_expected_tiles(documents, match_all_pairs(documents, init_search_length, block_size, HashingMode::prefix), init_search_length);
+                }
+            }
+        }
+
+        WHEN("Streaming the pairs block by block") {
+            AllPairsStream stream(documents, init_search_length, 1000);
+
+            THEN("Every block has the complete rows of its documents a, and all blocks together have every pair") {
+                AllPairsTiles all_pairs_tiles;
+                auto blocks = 0u;
+                while (not stream.finished()) {
+                    AllPairsTiles block_pairs;
+                    REQUIRE(stream.next(block_pairs));
+                    REQUIRE((all_pairs_tiles.empty() or block_pairs.empty() or all_pairs_tiles.back().a < block_pairs.front().a));
+                    for (const auto& pair : block_pairs) {
+                        all_pairs_tiles.push_back(pair);
+                    }
+                    ++blocks;
+                }
+                REQUIRE(blocks > 1);
+                AllPairsTiles none;
+                REQUIRE(not stream.next(none));
+                REQUIRE(none.empty());
+                require_expected_tiles(documents, all_pairs_tiles, init_search_length);
+            }
+        }
+
+        WHEN("Matching with a similarity cutoff, weighting documents by their unmarked tokens or by their length") {
+            THEN("Exactly the pairs above the cutoff are kept, with the tiles of matching all pairs") {
+                const auto& all_pairs_tiles = match_all_pairs(documents, init_search_length);
+                for (const auto& by_length : { false, true }) {
+                    SimilarityCutoff cutoff = { 0.0, {} };
+                    for (const auto& document : documents) {
+                        if (by_length) {
+                            cutoff.weights.push_back(document.first.size());
+                        }
+                    }
+                    const auto& similarity_of = [&](const PairTiles& pair) {
+                        const auto& weight_of = [&](const std::size_t& i) {
+                            const auto& document = documents[i];
+                            return by_length ? document.first.size() : document.first.size() - std::count(document.second.begin(), document.second.end(), '1');
+                        };
+                        std::size_t tokens_tiled = 0;
+                        for (const auto& tile : pair.tiles) {
+                            tokens_tiled += tile.match_length;
+                        }
+                        return tokens_tiled / (static_cast<double>(weight_of(pair.a) + weight_of(pair.b)) / 2);
+                    };
+                    // Keep about half of the pairs
+                    std::vector<double> similarities;
+                    for (const auto& pair : all_pairs_tiles) {
+                        similarities.push_back(similarity_of(pair));
+                    }
+                    std::sort(similarities.begin(), similarities.end());
+                    cutoff.minimum_similarity = similarities[similarities.size() / 2];
+                    std::vector<const PairTiles*> expected;
+                    for (const auto& pair : all_pairs_tiles) {
+                        if (similarity_of(pair) > cutoff.minimum_similarity) {
+                            expected.push_back(&pair);
+                        }
+                    }
+                    CAPTURE(by_length);
+                    REQUIRE(not expected.empty());
+                    REQUIRE(expected.size() < all_pairs_tiles.size());
+                    for (const auto& block_size : { 0lu, 1000lu }) {
+                        const auto& kept = match_all_pairs(documents, init_search_length, block_size, HashingMode::rolling, nullptr, &cutoff);
+                        REQUIRE(kept.size() == expected.size());
+                        for (auto i = 0u; i < kept.size(); ++i) {
+                            REQUIRE(kept[i].a == expected[i]->a);
+                            REQUIRE(kept[i].b == expected[i]->b);
+                            REQUIRE(kept[i].tiles.size() == expected[i]->tiles.size());
+                        }
+                    }
+                }
+            }
+        }
+
+        WHEN("Matching with a result cache") {
+            char path[] = "/tmp/gst_all_pairs_XXXXXX";
+            const auto fd = mkstemp(path);
+            REQUIRE(fd >= 0);
+            close(fd);
+            std::remove(path);
+            ResultCache cache(path);
+            const auto& all_pairs_tiles = match_all_pairs(documents, init_search_length, default_all_pairs_block_size, HashingMode::rolling, &cache);
+
+            THEN("Results are stored for every pair and read back") {
+                REQUIRE(cache.size() == all_pairs_tiles.size());
+                require_expected_tiles(documents, match_all_pairs(documents, init_search_length, 1000, HashingMode::rolling, &cache), init_search_length);
+                REQUIRE(cache.size() == all_pairs_tiles.size());
+            }
+            std::remove(path);
+        }
+    }
+
+    GIVEN("Fewer than two documents") {
+        THEN("There are no pairs") {
+            REQUIRE(match_all_pairs({}, 5).empty());
+            REQUIRE(match_all_pairs({ { "abcdef", "" } }, 5).empty());
+        }
+    }
+}
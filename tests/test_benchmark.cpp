@@ -1,87 +1,167 @@
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <random>
+#include <regex>
+#include <sstream>
+#include <tuple>
+#include <unordered_set>
 
 #include "gst.hpp"
+#include "sketch.hpp"
+#include "all_pairs.hpp"
+#include "window_fingerprints.hpp"
 #include "data_generator.hpp"
+#ifdef GST_PROFILE_PHASES
+#include "profiling.hpp"
+#endif
 
+/*
+ * Usage: run_benchmark [--list] [--scenario PREFIX]... [--seed N] [--json FILE] [--compare BASELINE_FILE] [--tolerance X]
+ *
+ *   --list         print the names of all scenarios and exit
+ *   --scenario     run only scenarios whose name starts with PREFIX, can be given several times, default all
+ *   --seed         seed of the data generator, default 1
+ *   --json         write the results as JSON to FILE, '-' for stdout
+ *   --compare      compare median times to a JSON file written earlier with --json,
+ *                  and exit with status 1 if some scenario is slower by more than the tolerance
+ *   --tolerance    allowed relative slowdown of the median time before reporting a regression, default 0.1
+ *
+ * The instrumented build run_benchmark_profiled also reports heap allocations per match_strings call,
+ * or per pair and per text in the all-pairs and one-to-many scenarios, in total and for each phase of match_strings,
+ * and the peak resident set size during each scenario, or of the process if the peak cannot be reset.
+ * Its times include the profiling overhead.
+ *
+ * The build run_benchmark_unfiltered indexes all windows without the presence filter of the streamed windows,
+ * run_benchmark --json filtered.json and then run_benchmark_unfiltered --compare filtered.json compares both.
+ */
+
+struct Workload {
+    std::string pattern;
+    std::string text;
+};
 
 struct Result {
-    double min_time = std::numeric_limits<double>::max();
-    double max_time = 0;
-    double total_time = 0;
-    match_length_t iterations = 0;
+    std::vector<double> times;
+    match_length_t tokens = 0;
     match_length_t match_count = 0;
-    float string_similarity = 0;
-    match_length_t str_len = 0;
+    // Scenario specific metrics
+    std::vector<std::pair<std::string, double> > extra;
+
+    double total_time() const {
+        double total = 0;
+        for (const auto& t : times) {
+            total += t;
+        }
+        return total;
+    }
+
+    // Nearest-rank percentile of the iteration times
+    double percentile(double p) const {
+        if (times.empty()) {
+            return 0;
+        }
+        std::vector<double> sorted(times);
+        std::sort(sorted.begin(), sorted.end());
+        const auto rank = static_cast<std::size_t>(std::ceil(p / 100.0 * sorted.size()));
+        return sorted[std::max<std::size_t>(rank, 1) - 1];
+    }
 };
 
-template<class T>
-struct TestArgs {
-    const T iterations;
-    const T text_size;
-    const T pattern_size;
-    const float random_copy_prob;
-    explicit TestArgs(T a, T b, T c, float d) :
-        iterations(a),
-        text_size(b),
-        pattern_size(c),
-        random_copy_prob(d) {}
+struct Scenario {
+    std::string name;
+    match_length_t iterations;
+    // Generate the input of one iteration, used by the default runner
+    std::function<Workload()> generate;
+    // Run all iterations of a scenario that does not call match_strings
+    std::function<Result(const Scenario&)> run;
 };
 
-constexpr auto table_width = 15;
 
-void dump_result_header(std::ostream& os) {
-    os << std::setw(table_width - 5) << "iterations"
-       << std::setw(table_width) << "string length"
-       << std::setw(table_width) << "similarity Pr"
-       << std::setw(table_width) << "min (s)"
-       << std::setw(table_width) << "max (s)"
-       << std::setw(table_width) << "avg (s)"
-       << std::setw(table_width) << "total (s)"
-       << std::setw(table_width) << "total matches"
-       << std::endl;
+#ifdef GST_PROFILE_PHASES
+static const char* phase_name(ProfilingPhase phase) {
+    switch (phase) {
+        case ProfilingPhase::tokens: return "tokens";
+        case ProfilingPhase::hash_index: return "hash_index";
+        case ProfilingPhase::matches: return "matches";
+        case ProfilingPhase::tiles: return "tiles";
+        default: return "other";
+    }
 }
 
-std::ostream& operator<<(std::ostream& os, const Result& res) {
-    auto avg = res.total_time / res.iterations;
-    os << std::setprecision(4)
-       << std::setw(table_width - 5) << res.iterations
-       << std::setw(table_width) << res.str_len
-       << std::setw(table_width) << res.string_similarity
-       << std::setw(table_width) << res.min_time
-       << std::setw(table_width) << res.max_time
-       << std::setw(table_width) << avg
-       << std::setw(table_width) << res.total_time
-       << std::setw(table_width) << res.match_count;
-    return os;
-}
-
-template<class T>
-Result bench_match_strings(const TestArgs<T>& args) {
-    const auto init_search_length = std::min(20lu, args.pattern_size);
-    auto iterations = args.iterations;
+// Sum of allocation counters over all calls, with the maximum peak of a single call
+static void accumulate(AllocationStats& sum, const AllocationStats& stats) {
+    sum.allocations += stats.allocations;
+    sum.bytes += stats.bytes;
+    sum.peak_live_bytes = std::max(sum.peak_live_bytes, stats.peak_live_bytes);
+}
+
+static void add_allocation_metrics(Result& res, const std::string& prefix, const AllocationStats& sum, match_length_t calls) {
+    res.extra.emplace_back(prefix + "allocations_per_call", static_cast<double>(sum.allocations) / calls);
+    res.extra.emplace_back(prefix + "bytes_per_call", static_cast<double>(sum.bytes) / calls);
+    res.extra.emplace_back(prefix + "peak_live_bytes", sum.peak_live_bytes);
+}
+
+// Allocation counters of the timed parts of a scenario, in total and for each phase of match_strings
+struct ScenarioAllocations {
+    AllocationStats total;
+    std::vector<AllocationStats> phases = std::vector<AllocationStats>(static_cast<unsigned>(ProfilingPhase::count));
+
+    // Add the counters since the last profiling_reset
+    void accumulate_since_reset() {
+        accumulate(total, profiling_total());
+        for (auto phase = 0u; phase < phases.size(); ++phase) {
+            accumulate(phases[phase], profiling_phase(static_cast<ProfilingPhase>(phase)));
+        }
+    }
+
+    // Add the metrics of all counters divided by the amount of calls, e.g. of match_strings or of pairs matched
+    void add_metrics(Result& res, match_length_t calls) const {
+        if (calls == 0) {
+            return;
+        }
+        add_allocation_metrics(res, "", total, calls);
+        for (auto phase = 0u; phase < phases.size(); ++phase) {
+            const auto& name = phase_name(static_cast<ProfilingPhase>(phase));
+            add_allocation_metrics(res, std::string(name) + "_", phases[phase], calls);
+        }
+    }
+};
+#endif
+
+Result bench_match_strings(const Scenario& scenario) {
     Result res;
+#ifdef GST_PROFILE_PHASES
+    ScenarioAllocations allocations;
+#endif
 
-    while(iterations-- > 0) {
-        const std::string text = next_string(args.text_size);
-        const std::string pattern = random_string_copy(text, args.random_copy_prob);
+    for (auto i = 0u; i < scenario.iterations; ++i) {
+        const auto& workload = scenario.generate();
+        const auto& pattern = workload.pattern;
+        const auto& text = workload.text;
+        const auto init_search_length = std::min(20lu, pattern.size());
 
+#ifdef GST_PROFILE_PHASES
+        profiling_reset();
+#endif
         auto start = std::chrono::high_resolution_clock::now();
         const auto& tiles = match_strings(pattern, text, init_search_length);
         auto end = std::chrono::high_resolution_clock::now();
+#ifdef GST_PROFILE_PHASES
+        allocations.accumulate_since_reset();
+#endif
 
         std::chrono::duration<double> elapsed = end - start;
-        auto elapsed_c = elapsed.count();
-        res.max_time = std::max(res.max_time, elapsed_c);
-        res.min_time = std::min(res.min_time, elapsed_c);
-        res.total_time += elapsed_c;
-        res.iterations++;
-        res.string_similarity = args.random_copy_prob;
-        res.str_len = args.text_size;
+        res.times.push_back(elapsed.count());
+        res.tokens += pattern.size() + text.size();
 
         for (auto& tile : tiles) {
             const auto& pattern_str = pattern.substr(tile.pattern_index, tile.match_length);
@@ -94,99 +174,629 @@ Result bench_match_strings(const TestArgs<T>& args) {
         res.match_count += tiles.size();
     }
 
+#ifdef GST_PROFILE_PHASES
+    allocations.add_metrics(res, scenario.iterations);
+#endif
+
     return res;
 }
 
-int main() {
 
-    std::cout << "\nBENCHMARKING\n" << std::endl;
-    std::cout << "Tiny random strings" << std::endl;
-    {
-        double total_time = 0;
-        constexpr auto iterations = 500;
-        constexpr auto text_len = 20;
-        constexpr auto pattern_len = text_len;
-        dump_result_header(std::cout);
-        for (auto p = 0; p <= 4; ++p) {
-            const float copy_prob = 0.5f + p / 8.0f;
-            const TestArgs<match_length_t> args{ iterations, text_len, pattern_len, copy_prob};
-            auto res = bench_match_strings(args);
-            std::cout << res  << std::endl;
-            total_time += res.total_time;
-        }
-        std::cout << "5 * " << iterations << " iterations, total (sec): " << std::setprecision(2) << total_time << std::endl;
-        std::cout << std::endl;
-    }
-
-    std::cout << "Short random strings" << std::endl;
-    {
-        double total_time = 0;
-        constexpr auto iterations = 250;
-        constexpr auto text_len = 1000;
-        constexpr auto pattern_len = text_len;
-        dump_result_header(std::cout);
-        for (auto p = 0; p <= 4; ++p) {
-            const float copy_prob = 0.5f + p / 8.0f;
-            const TestArgs<match_length_t> args{ iterations, text_len, pattern_len, copy_prob};
-            auto res = bench_match_strings(args);
-            std::cout << res  << std::endl;
-            total_time += res.total_time;
-        }
-        std::cout << "5 * " << iterations << " iterations, total (sec): " << std::setprecision(2) << total_time << std::endl;
-        std::cout << std::endl;
-    }
-
-    std::cout << "Long random strings" << std::endl;
-    {
-        double total_time = 0;
-        constexpr auto iterations = 25;
-        constexpr auto text_len = 50000;
-        constexpr auto pattern_len = text_len;
-        dump_result_header(std::cout);
-        for (auto p = 0; p <= 4; ++p) {
-            const float copy_prob = 0.5f + p / 8.0f;
-            const TestArgs<match_length_t> args{ iterations, text_len, pattern_len, copy_prob};
-            auto res = bench_match_strings(args);
-            std::cout << res  << std::endl;
-            total_time += res.total_time;
-        }
-        std::cout << "5 * " << iterations << " iterations, total (sec): " << std::setprecision(2) << total_time << std::endl;
-        std::cout << std::endl;
-    }
-
-    std::cout << "Very long random strings" << std::endl;
-    {
-        double total_time = 0;
-        constexpr auto iterations = 5;
-        constexpr auto text_len = 200000;
-        constexpr auto pattern_len = text_len;
-        dump_result_header(std::cout);
-        for (auto p = 0; p <= 4; ++p) {
-            const float copy_prob = 0.5f + p / 8.0f;
-            const TestArgs<match_length_t> args{ iterations, text_len, pattern_len, copy_prob};
-            auto res = bench_match_strings(args);
-            std::cout << res  << std::endl;
-            total_time += res.total_time;
-        }
-        std::cout << "5 * " << iterations << " iterations, total (sec): " << std::setprecision(2) << total_time << std::endl;
-        std::cout << std::endl;
-    }
-
-    std::cout << "Excessively long random strings" << std::endl;
-    {
-        double total_time = 0;
-        constexpr auto iterations = 1;
-        constexpr auto text_len = 1000000;
-        constexpr auto pattern_len = text_len;
-        dump_result_header(std::cout);
+static std::unordered_set<std::string> kgram_set(const std::string& s, match_length_t kgram_length) {
+    std::unordered_set<std::string> kgrams;
+    for (auto i = 0u; i + kgram_length <= s.size(); ++i) {
+        kgrams.insert(s.substr(i, kgram_length));
+    }
+    return kgrams;
+}
+
+static double exact_jaccard(const std::unordered_set<std::string>& a, const std::unordered_set<std::string>& b) {
+    match_length_t intersection = 0;
+    for (const auto& kgram : a) {
+        intersection += b.count(kgram);
+    }
+    const auto union_size = a.size() + b.size() - intersection;
+    return union_size > 0 ? static_cast<double>(intersection) / union_size : 0.0;
+}
+
+// Generate clusters of random copies of random base strings and compare the LSH candidates to exact Jaccard similarities
+Result bench_sketch_candidates(match_length_t iterations, match_length_t clusters, match_length_t cluster_size, match_length_t text_size, float copy_prob, match_length_t kgram_length, double threshold) {
+    Result res;
+    match_length_t true_pair_count = 0;
+    match_length_t true_candidate_count = 0;
+
+    for (auto iteration = 0u; iteration < iterations; ++iteration) {
+        std::vector<std::pair<std::string, std::string> > documents;
+        for (auto c = 0u; c < clusters; ++c) {
+            const std::string base = next_string(text_size);
+            documents.emplace_back(base, "");
+            for (auto i = 1u; i < cluster_size; ++i) {
+                documents.emplace_back(random_string_copy(base, copy_prob), "");
+            }
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        const auto& candidates = sketch_candidates(documents, kgram_length, threshold, 32, 4);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        res.times.push_back(std::chrono::duration<double>(end - start).count());
+        res.tokens += documents.size() * text_size;
+        res.match_count += candidates.size();
+
+        std::vector<std::unordered_set<std::string> > kgrams;
+        for (const auto& document : documents) {
+            kgrams.push_back(kgram_set(document.first, kgram_length));
+        }
+        std::unordered_set<std::uint64_t> true_pairs;
+        for (auto a = 0u; a < documents.size(); ++a) {
+            for (auto b = a + 1; b < documents.size(); ++b) {
+                if (exact_jaccard(kgrams[a], kgrams[b]) >= threshold) {
+                    true_pairs.insert(static_cast<std::uint64_t>(a) << 32 | b);
+                }
+            }
+        }
+        true_pair_count += true_pairs.size();
+        for (const auto& candidate : candidates) {
+            true_candidate_count += true_pairs.count(static_cast<std::uint64_t>(candidate.a) << 32 | candidate.b);
+        }
+    }
+
+    const auto recall = true_pair_count > 0 ? static_cast<double>(true_candidate_count) / true_pair_count : 1.0;
+    res.extra.emplace_back("true_pairs", true_pair_count);
+    res.extra.emplace_back("recall", recall);
+    return res;
+}
+
+
+// Match all pairs of a corpus of small documents in clusters of random copies, row by row with match_strings if block_size is 0, else with match_all_pairs
+Result bench_all_pairs(match_length_t iterations, match_length_t document_count, match_length_t text_size, bool row_wise, std::size_t block_size, HashingMode hashing_mode) {
+    Result res;
+    match_length_t pair_count = 0;
+#ifdef GST_PROFILE_PHASES
+    ScenarioAllocations allocations;
+#endif
+
+    for (auto iteration = 0u; iteration < iterations; ++iteration) {
+        std::vector<std::pair<std::string, std::string> > documents;
+        std::string base;
+        for (auto i = 0u; i < document_count; ++i) {
+            if (i % 8 == 0) {
+                base = next_string(text_size);
+            }
+            documents.emplace_back(random_string_copy(base, 0.9f), "");
+        }
+
+        match_length_t match_count = 0;
+#ifdef GST_PROFILE_PHASES
+        profiling_reset();
+#endif
+        auto start = std::chrono::high_resolution_clock::now();
+        if (row_wise) {
+            for (auto a = 0u; a < documents.size(); ++a) {
+                for (auto b = a + 1; b < documents.size(); ++b) {
+                    match_count += match_strings(documents[a].first, documents[b].first, 20, "", "", hashing_mode).size();
+                }
+            }
+        } else {
+            for (const auto& pair : match_all_pairs(documents, 20, block_size, hashing_mode)) {
+                match_count += pair.tiles.size();
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+#ifdef GST_PROFILE_PHASES
+        allocations.accumulate_since_reset();
+#endif
+
+        res.times.push_back(std::chrono::duration<double>(end - start).count());
+        res.tokens += (document_count - 1) * document_count * text_size;
+        res.match_count += match_count;
+        pair_count += document_count * (document_count - 1) / 2;
+    }
+
+    const auto total = res.total_time();
+    res.extra.emplace_back("pairs_per_second", total > 0 ? pair_count / total : 0);
+#ifdef GST_PROFILE_PHASES
+    allocations.add_metrics(res, pair_count);
+#endif
+    return res;
+}
+
+
+// Match one query against many texts, mostly unrelated and some random copies of the query, with one match_strings call per text or with match_one_to_many
+Result bench_one_to_many(match_length_t iterations, match_length_t text_count, match_length_t text_size, bool separate) {
+    Result res;
+#ifdef GST_PROFILE_PHASES
+    ScenarioAllocations allocations;
+#endif
+
+    for (auto iteration = 0u; iteration < iterations; ++iteration) {
+        const auto& query = next_string(text_size);
+        std::vector<std::pair<std::string, std::string> > texts;
+        for (auto i = 0u; i < text_count; ++i) {
+            texts.emplace_back(i % 10 == 0 ? random_string_copy(query, 0.9f) : next_string(text_size), "");
+        }
+
+        match_length_t match_count = 0;
+#ifdef GST_PROFILE_PHASES
+        profiling_reset();
+#endif
+        auto start = std::chrono::high_resolution_clock::now();
+        if (separate) {
+            for (const auto& text : texts) {
+                match_count += match_strings(query, text.first, 20, "", text.second).size();
+            }
+        } else {
+            for (const auto& tiles : match_one_to_many(query, texts, 20)) {
+                match_count += tiles.size();
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+#ifdef GST_PROFILE_PHASES
+        allocations.accumulate_since_reset();
+#endif
+
+        res.times.push_back(std::chrono::duration<double>(end - start).count());
+        res.tokens += text_count * 2 * text_size;
+        res.match_count += match_count;
+    }
+#ifdef GST_PROFILE_PHASES
+    allocations.add_metrics(res, iterations * text_count);
+#endif
+    return res;
+}
+
+
+// Hash all windows of length 20 of many short documents, one document at a time with window_fingerprints or with batch_window_fingerprints
+Result bench_fingerprints(match_length_t iterations, match_length_t document_count, match_length_t text_size, bool separate) {
+    Result res;
+
+    for (auto iteration = 0u; iteration < iterations; ++iteration) {
+        std::vector<std::pair<std::string, std::string> > documents;
+        for (auto i = 0u; i < document_count; ++i) {
+            // Lengths vary by up to a quarter, as in a set of submissions to one exercise
+            documents.emplace_back(next_string(text_size - next_integer(0lu, text_size / 4)), "");
+        }
+
+        match_length_t fingerprint_count = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (separate) {
+            for (const auto& document : documents) {
+                fingerprint_count += window_fingerprints(document.first, 20).size();
+            }
+        } else {
+            for (const auto& fingerprints : batch_window_fingerprints(documents, 20)) {
+                fingerprint_count += fingerprints.size();
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        res.times.push_back(std::chrono::duration<double>(end - start).count());
+        for (const auto& document : documents) {
+            res.tokens += document.first.size();
+        }
+        res.match_count += fingerprint_count;
+    }
+    return res;
+}
+
+
+static std::string copy_prob_str(float copy_prob) {
+    std::ostringstream os;
+    os << "p" << copy_prob;
+    return os.str();
+}
+
+std::vector<Scenario> all_scenarios() {
+    std::vector<Scenario> scenarios;
+
+    // Uniformly random printable strings and random copies of them
+    const std::vector<std::tuple<std::string, match_length_t, match_length_t> > random_sizes = {
+        std::make_tuple("tiny", 500, 20),
+        std::make_tuple("short", 250, 1000),
+        std::make_tuple("long", 25, 50000),
+        std::make_tuple("very-long", 5, 200000),
+        std::make_tuple("excessive", 1, 1000000),
+    };
+    for (const auto& size : random_sizes) {
         for (auto p = 0; p <= 4; ++p) {
             const float copy_prob = 0.5f + p / 8.0f;
-            const TestArgs<match_length_t> args{ iterations, text_len, pattern_len, copy_prob};
-            auto res = bench_match_strings(args);
-            std::cout << res  << std::endl;
-            total_time += res.total_time;
+            const auto text_size = std::get<2>(size);
+            scenarios.push_back({
+                "random/" + std::get<0>(size) + "/" + copy_prob_str(copy_prob),
+                std::get<1>(size),
+                [text_size, copy_prob]() {
+                    Workload w;
+                    w.text = next_string(text_size);
+                    w.pattern = random_string_copy(w.text, copy_prob);
+                    return w;
+                },
+                nullptr,
+            });
+        }
+    }
+
+    // Near copies, with long matches that exceed twice the search length in most passes
+    for (const auto& size : random_sizes) {
+        const auto text_size = std::get<2>(size);
+        if (text_size > 200000) {
+            continue;
+        }
+        for (const auto& copy_prob : { 0.99f, 0.999f }) {
+            scenarios.push_back({
+                "random/" + std::get<0>(size) + "/" + copy_prob_str(copy_prob),
+                std::get<1>(size),
+                [text_size, copy_prob]() {
+                    Workload w;
+                    w.text = next_string(text_size);
+                    w.pattern = random_string_copy(w.text, copy_prob);
+                    return w;
+                },
+                nullptr,
+            });
+            // The pattern has fewer unmarked tokens than the text in every pass, as when matchlib passes the shorter string as the pattern
+            scenarios.push_back({
+                "random/" + std::get<0>(size) + "/" + copy_prob_str(copy_prob) + "/shorter-pattern",
+                std::get<1>(size),
+                [text_size, copy_prob]() {
+                    Workload w;
+                    w.text = next_string(text_size);
+                    w.pattern = random_string_copy(w.text, copy_prob);
+                    w.pattern.pop_back();
+                    return w;
+                },
+                nullptr,
+            });
+        }
+    }
+
+    // Near copies of a quarter of the text, so the pattern is indexed and its long matches start in the middle of the text
+    for (const auto& size : random_sizes) {
+        const auto text_size = std::get<2>(size);
+        if (text_size > 200000) {
+            continue;
+        }
+        scenarios.push_back({
+            "random/" + std::get<0>(size) + "/contained-pattern",
+            std::get<1>(size),
+            [text_size]() {
+                Workload w;
+                w.text = next_string(text_size);
+                w.pattern = random_string_copy(w.text.substr(text_size / 2, text_size / 4), 0.999f);
+                return w;
+            },
+            nullptr,
+        });
+    }
+
+    // Unrelated uniformly random strings, where almost no window of one string occurs in the other
+    for (const auto& size : random_sizes) {
+        const auto text_size = std::get<2>(size);
+        if (text_size > 50000) {
+            continue;
+        }
+        scenarios.push_back({
+            "random/" + std::get<0>(size) + "/unrelated",
+            std::get<1>(size),
+            [text_size]() {
+                Workload w;
+                w.text = next_string(text_size);
+                w.pattern = next_string(text_size);
+                return w;
+            },
+            nullptr,
+        });
+    }
+
+    // Zipf-distributed characters, where few characters dominate and hash buckets of repeated substrings grow large
+    const std::vector<std::tuple<std::string, match_length_t, match_length_t> > zipf_sizes = {
+        std::make_tuple("short", 250, 1000),
+        std::make_tuple("long", 10, 50000),
+    };
+    for (const auto& size : zipf_sizes) {
+        const auto text_size = std::get<2>(size);
+        scenarios.push_back({
+            "zipf/" + std::get<0>(size) + "/p0.9",
+            std::get<1>(size),
+            [text_size]() {
+                Workload w;
+                w.text = next_zipf_string(text_size, 16, 1.2);
+                w.pattern = random_string_copy(w.text, 0.9);
+                return w;
+            },
+            nullptr,
+        });
+    }
+
+    // Code-like token streams, either plagiarized or independently generated
+    const std::vector<std::tuple<std::string, match_length_t, match_length_t, match_length_t> > code_sizes = {
+        std::make_tuple("short", 250, 1000, 3),
+        std::make_tuple("long", 10, 50000, 50),
+    };
+    for (const auto& size : code_sizes) {
+        const auto text_size = std::get<2>(size);
+        const auto transform_count = std::get<3>(size);
+        scenarios.push_back({
+            "code/" + std::get<0>(size) + "/plagiarized",
+            std::get<1>(size),
+            [text_size, transform_count]() {
+                Workload w;
+                w.text = next_code_string(text_size);
+                w.pattern = plagiarized_copy(w.text, 0.02, transform_count, transform_count, 40lu);
+                return w;
+            },
+            nullptr,
+        });
+        scenarios.push_back({
+            "code/" + std::get<0>(size) + "/unrelated",
+            std::get<1>(size),
+            [text_size]() {
+                Workload w;
+                w.text = next_code_string(text_size);
+                w.pattern = next_code_string(text_size);
+                return w;
+            },
+            nullptr,
+        });
+    }
+
+    // MinHash/LSH screening of clusters of 4 random copies, k-gram length 5, threshold 0.5
+    for (auto p = 0; p <= 4; ++p) {
+        const float copy_prob = 0.875f + p / 32.0f;
+        scenarios.push_back({
+            "sketch/" + copy_prob_str(copy_prob),
+            1,
+            nullptr,
+            [copy_prob](const Scenario& scenario) {
+                return bench_sketch_candidates(scenario.iterations, 100, 4, 2000, copy_prob, 5, 0.5);
+            },
+        });
+    }
+
+    // All pairs of 250 documents of 200 characters, row by row with match_strings and in blocks of prepared documents of different sizes
+    for (const auto& hashing_mode : { HashingMode::rolling, HashingMode::prefix }) {
+        const std::string mode_name = hashing_mode == HashingMode::prefix ? "prefix" : "rolling";
+        scenarios.push_back({
+            "all-pairs/" + mode_name + "/row-wise",
+            3,
+            nullptr,
+            [hashing_mode](const Scenario& scenario) {
+                return bench_all_pairs(scenario.iterations, 250, 200, true, 0, hashing_mode);
+            },
+        });
+        for (const auto& block_size : { 0lu, 16 * 1024lu, 128 * 1024lu, 1024 * 1024lu }) {
+            scenarios.push_back({
+                "all-pairs/" + mode_name + "/block-" + std::to_string(block_size / 1024) + "k",
+                3,
+                nullptr,
+                [hashing_mode, block_size](const Scenario& scenario) {
+                    return bench_all_pairs(scenario.iterations, 250, 200, false, block_size, hashing_mode);
+                },
+            });
+        }
+    }
+
+    // One query of 1000 characters against 200 texts, with one call per text or in a single pass over the query
+    scenarios.push_back({
+        "one-to-many/separate",
+        10,
+        nullptr,
+        [](const Scenario& scenario) {
+            return bench_one_to_many(scenario.iterations, 200, 1000, true);
+        },
+    });
+    scenarios.push_back({
+        "one-to-many/combined",
+        10,
+        nullptr,
+        [](const Scenario& scenario) {
+            return bench_one_to_many(scenario.iterations, 200, 1000, false);
+        },
+    });
+
+    // Window fingerprints of 2000 documents of about 200 characters, one document at a time or in batches of SIMD lanes
+    for (const auto& separate : { true, false }) {
+        scenarios.push_back({
+            std::string("fingerprints/") + (separate ? "separate" : "batch"),
+            20,
+            nullptr,
+            [separate](const Scenario& scenario) {
+                return bench_fingerprints(scenario.iterations, 2000, 200, separate);
+            },
+        });
+    }
+
+    return scenarios;
+}
+
+
+constexpr auto table_width = 13;
+
+void dump_result_header(std::ostream& os) {
+    os << std::left << std::setw(28) << "scenario" << std::right
+       << std::setw(table_width - 3) << "iterations"
+       << std::setw(table_width) << "p50 (s)"
+       << std::setw(table_width) << "p90 (s)"
+       << std::setw(table_width) << "p99 (s)"
+       << std::setw(table_width) << "max (s)"
+       << std::setw(table_width) << "total (s)"
+       << std::setw(table_width) << "tokens/s"
+       << std::setw(table_width) << "matches/s"
+       << std::endl;
+}
+
+void dump_result(std::ostream& os, const std::string& name, const Result& res) {
+    const auto total = res.total_time();
+    os << std::setprecision(4)
+       << std::left << std::setw(28) << name << std::right
+       << std::setw(table_width - 3) << res.times.size()
+       << std::setw(table_width) << res.percentile(50)
+       << std::setw(table_width) << res.percentile(90)
+       << std::setw(table_width) << res.percentile(99)
+       << std::setw(table_width) << res.percentile(100)
+       << std::setw(table_width) << total
+       << std::setw(table_width) << (total > 0 ? res.tokens / total : 0)
+       << std::setw(table_width) << (total > 0 ? res.match_count / total : 0);
+    for (const auto& metric : res.extra) {
+        os << "  " << metric.first << " " << metric.second;
+    }
+    os << std::endl;
+}
+
+// One scenario per line, which keeps the output readable by read_baseline
+void dump_json(std::ostream& os, unsigned seed, const std::vector<std::pair<std::string, Result> >& results) {
+    os << std::setprecision(9) << "{\"seed\":" << seed << ",\"scenarios\":[\n";
+    for (auto i = 0u; i < results.size(); ++i) {
+        const auto& name = results[i].first;
+        const auto& res = results[i].second;
+        const auto total = res.total_time();
+        os << "{\"name\":\"" << name << "\""
+           << ",\"iterations\":" << res.times.size()
+           << ",\"min\":" << res.percentile(0)
+           << ",\"p50\":" << res.percentile(50)
+           << ",\"p90\":" << res.percentile(90)
+           << ",\"p99\":" << res.percentile(99)
+           << ",\"max\":" << res.percentile(100)
+           << ",\"mean\":" << (res.times.empty() ? 0 : total / res.times.size())
+           << ",\"total\":" << total
+           << ",\"tokens\":" << res.tokens
+           << ",\"matches\":" << res.match_count
+           << ",\"tokens_per_second\":" << (total > 0 ? res.tokens / total : 0)
+           << ",\"matches_per_second\":" << (total > 0 ? res.match_count / total : 0);
+        for (const auto& metric : res.extra) {
+            os << ",\"" << metric.first << "\":" << metric.second;
         }
-        std::cout << "5 * " << iterations << " iterations, total (sec): " << std::setprecision(2) << total_time << std::endl;
-        std::cout << std::endl;
+        os << "}" << (i + 1 < results.size() ? "," : "") << "\n";
     }
+    os << "]}" << std::endl;
+}
+
+// Read the median time of each scenario from a file written by dump_json
+std::map<std::string, double> read_baseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream is(path);
+    const std::regex name_re("\"name\":\"([^\"]+)\"");
+    const std::regex p50_re("\"p50\":([-+0-9.eE]+)");
+    std::string line;
+    while (std::getline(is, line)) {
+        std::smatch name_match, p50_match;
+        if (std::regex_search(line, name_match, name_re) and std::regex_search(line, p50_match, p50_re)) {
+            baseline[name_match[1]] = std::stod(p50_match[1]);
+        }
+    }
+    return baseline;
+}
+
+// Print the relative change in median time for all scenarios in the baseline and return the amount of regressions
+unsigned compare_to_baseline(std::ostream& os, const std::map<std::string, double>& baseline,
+        const std::vector<std::pair<std::string, Result> >& results, double tolerance) {
+    unsigned regressions = 0;
+    os << std::left << std::setw(28) << "scenario" << std::right
+       << std::setw(table_width) << "baseline p50"
+       << std::setw(table_width) << "p50"
+       << std::setw(table_width) << "change"
+       << std::endl;
+    for (const auto& result : results) {
+        const auto& baseline_it = baseline.find(result.first);
+        if (baseline_it == baseline.end() or baseline_it->second <= 0) {
+            continue;
+        }
+        const auto p50 = result.second.percentile(50);
+        const auto change = p50 / baseline_it->second - 1.0;
+        const bool is_regression = change > tolerance;
+        regressions += is_regression;
+        os << std::setprecision(4)
+           << std::left << std::setw(28) << result.first << std::right
+           << std::setw(table_width) << baseline_it->second
+           << std::setw(table_width) << p50
+           << std::setw(table_width - 1) << std::showpos << change * 100 << std::noshowpos << "%"
+           << (is_regression ? "  REGRESSION" : "")
+           << std::endl;
+    }
+    return regressions;
+}
+
+
+int main(int argc, char** argv) {
+    unsigned seed = 1;
+    std::vector<std::string> prefixes;
+    std::string json_path;
+    std::string baseline_path;
+    double tolerance = 0.1;
+    bool list_only = false;
+
+    for (auto i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--list") {
+            list_only = true;
+        } else if (arg == "--scenario" and has_value) {
+            prefixes.push_back(argv[++i]);
+        } else if (arg == "--seed" and has_value) {
+            seed = std::stoul(argv[++i]);
+        } else if (arg == "--json" and has_value) {
+            json_path = argv[++i];
+        } else if (arg == "--compare" and has_value) {
+            baseline_path = argv[++i];
+        } else if (arg == "--tolerance" and has_value) {
+            tolerance = std::stod(argv[++i]);
+        } else {
+            std::cerr << "Unknown or incomplete argument " << arg << ", see the usage at the top of tests/test_benchmark.cpp" << std::endl;
+            return 2;
+        }
+    }
+
+    std::vector<Scenario> scenarios;
+    for (const auto& scenario : all_scenarios()) {
+        const bool selected = prefixes.empty() or std::any_of(prefixes.begin(), prefixes.end(),
+                [&scenario](const std::string& prefix) { return scenario.name.compare(0, prefix.size(), prefix) == 0; });
+        if (selected) {
+            scenarios.push_back(scenario);
+        }
+    }
+
+    if (list_only) {
+        for (const auto& scenario : scenarios) {
+            std::cout << scenario.name << std::endl;
+        }
+        return 0;
+    }
+
+    // JSON written to stdout replaces the table
+    std::ostream& table_os = json_path == "-" ? std::cerr : std::cout;
+    table_os << "\nBENCHMARKING, seed " << seed << "\n" << std::endl;
+    dump_result_header(table_os);
+
+    std::vector<std::pair<std::string, Result> > results;
+    for (const auto& scenario : scenarios) {
+        // Every scenario gets the same data regardless of which scenarios were selected
+        reseed_data_generator(seed);
+#ifdef GST_PROFILE_PHASES
+        // Without a reset, the peak of the process is reported, which includes the earlier scenarios
+        const bool peak_rss_reset = profiling_reset_peak_rss();
+#endif
+        auto res = scenario.run ? scenario.run(scenario) : bench_match_strings(scenario);
+#ifdef GST_PROFILE_PHASES
+        res.extra.emplace_back(peak_rss_reset ? "peak_rss_kb" : "process_peak_rss_kb", profiling_peak_rss_kb());
+#endif
+        dump_result(table_os, scenario.name, res);
+        results.emplace_back(scenario.name, res);
+    }
+    table_os << std::endl;
+
+    if (json_path == "-") {
+        dump_json(std::cout, seed, results);
+    } else if (not json_path.empty()) {
+        std::ofstream json_os(json_path);
+        dump_json(json_os, seed, results);
+    }
+
+    if (not baseline_path.empty()) {
+        const auto& regressions = compare_to_baseline(table_os, read_baseline(baseline_path), results, tolerance);
+        if (regressions > 0) {
+            table_os << regressions << " scenario(s) regressed by more than " << tolerance * 100 << "%" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
 }
@@ -0,0 +1,84 @@
+#include "duplicates.hpp"
+#include "gst.hpp"
+#include "data_generator.hpp"
+#include "catch.hpp"
+
+
+SCENARIO("Identical documents are grouped into the same class", "[duplicates-exact]") {
+    CAPTURE(data_generator_seed());
+
+    GIVEN("Two random strings, the first repeated three times and the second twice") {
+        const std::string a = next_string(1000lu);
+        const std::string b = next_string(1000lu);
+        const std::vector<std::pair<std::string, std::string> > documents = {
+            { a, "" }, { b, "" }, { a, "" }, { b, "0" }, { a, std::string(a.size(), '0') },
+        };
+
+        WHEN("Grouping duplicates") {
+            const auto& classes = group_duplicates(documents, false);
+
+            THEN("There are two classes with the first occurrence as representative") {
+                REQUIRE(classes.size() == 2);
+                REQUIRE(classes[0] == std::vector<std::size_t>({ 0, 2, 4 }));
+                REQUIRE(classes[1] == std::vector<std::size_t>({ 1, 3 }));
+            }
+        }
+    }
+
+    GIVEN("Two equal strings with different marks") {
+        const std::string a = "abcdefghijklmnopqrst";
+        const std::vector<std::pair<std::string, std::string> > documents = {
+            { a, "" }, { a, "00001" },
+        };
+
+        WHEN("Grouping duplicates") {
+            const auto& classes = group_duplicates(documents, false);
+
+            THEN("The strings are not duplicates") {
+                REQUIRE(classes.size() == 2);
+            }
+        }
+    }
+}
+
+
+SCENARIO("Documents that differ only in marked tokens are optionally grouped together", "[duplicates-ignore-marked]") {
+    CAPTURE(data_generator_seed());
+
+    GIVEN("Two strings that differ only in a marked region") {
+        const std::string a = "abcdefghijklmnopqrst";
+        const std::string b = "abcdefghijXXXXXXXXXX";
+        const std::string marks = "00000000001111111111";
+        const std::vector<std::pair<std::string, std::string> > documents = {
+            { a, marks }, { b, marks },
+        };
+
+        WHEN("Grouping duplicates without ignoring marked tokens") {
+            const auto& classes = group_duplicates(documents, false);
+
+            THEN("The strings are not duplicates") {
+                REQUIRE(classes.size() == 2);
+            }
+        }
+
+        WHEN("Grouping duplicates and ignoring marked tokens") {
+            const auto& classes = group_duplicates(documents, true);
+
+            THEN("The strings are duplicates") {
+                REQUIRE(classes.size() == 1);
+            }
+
+            THEN("Both strings produce the same tiles when matched against a third string") {
+                const std::string pattern = "klmnoabcdefghijpqrst";
+                const auto& tiles_a = match_strings(pattern, a, 4, "", marks);
+                const auto& tiles_b = match_strings(pattern, b, 4, "", marks);
+                REQUIRE(tiles_a.size() == tiles_b.size());
+                for (auto i = 0u; i < tiles_a.size(); ++i) {
+                    REQUIRE(tiles_a[i].pattern_index == tiles_b[i].pattern_index);
+                    REQUIRE(tiles_a[i].text_index == tiles_b[i].text_index);
+                    REQUIRE(tiles_a[i].match_length == tiles_b[i].match_length);
+                }
+            }
+        }
+    }
+}
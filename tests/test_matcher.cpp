@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <functional>
+#include <tuple>
 #include "gst.hpp"
 #include "data_generator.hpp"
 #define CATCH_CONFIG_MAIN
@@ -26,8 +28,100 @@ static bool all_matches_are_non_overlapping(const Tiles& tiles) {
 }
 
 
+/*
+ * Greedy String Tiling as originally implemented, without hashing: every pass streams the unmarked windows of the pattern
+ * through all unmarked windows of the text, restarts at the length of the first match longer than 2 * search_length,
+ * and tiles the matches in the order they were found.
+ */
+static Tiles baseline_tiles(const std::string& pattern, const std::string& text, const match_length_t& init_search_length,
+        const std::string& init_pattern_marks = "", const std::string& init_text_marks = "") {
+    Tiles tiles;
+    if (pattern.size() < init_search_length || text.size() < init_search_length) {
+        return tiles;
+    }
+    std::vector<bool> pattern_marks(pattern.size());
+    for (auto i = 0u; i < pattern.size(); ++i) {
+        pattern_marks[i] = i < init_pattern_marks.size() and init_pattern_marks[i] == '1';
+    }
+    std::vector<bool> text_marks(text.size());
+    for (auto i = 0u; i < text.size(); ++i) {
+        text_marks[i] = i < init_text_marks.size() and init_text_marks[i] == '1';
+    }
+    const auto& is_match = [&](const std::size_t& p, const std::size_t& t, const std::size_t& length) {
+        for (auto i = 0u; i < length; ++i) {
+            if (pattern_marks[p + i] or text_marks[t + i] or pattern[p + i] != text[t + i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    match_length_t search_length = init_search_length;
+    match_length_t length_of_tokens_tiled = 0;
+    unsigned tiled_count_repeats = 0;
+    while (search_length > 0 and search_length >= init_search_length) {
+        std::vector<std::tuple<std::size_t, std::size_t, match_length_t> > matches;
+        match_length_t long_match = 0;
+        for (auto p = 0u; p + search_length <= pattern.size() and long_match == 0; ++p) {
+            for (auto t = 0u; t + search_length <= text.size() and long_match == 0; ++t) {
+                if (not is_match(p, t, search_length)) {
+                    continue;
+                }
+                auto length = search_length;
+                while (p + length < pattern.size() and t + length < text.size() and is_match(p + length, t + length, 1)) {
+                    ++length;
+                }
+                if (length > 2 * search_length) {
+                    long_match = length;
+                } else {
+                    matches.emplace_back(p, t, length);
+                }
+            }
+        }
+        if (long_match > 0) {
+            search_length = long_match;
+            continue;
+        }
+
+        const auto prev_length_of_tokens_tiled = length_of_tokens_tiled;
+        for (const auto& match : matches) {
+            const auto& p = std::get<0>(match);
+            const auto& t = std::get<1>(match);
+            const auto& length = std::get<2>(match);
+            if (is_match(p, t, length)) {
+                for (auto i = 0u; i < length; ++i) {
+                    pattern_marks[p + i] = true;
+                    text_marks[t + i] = true;
+                }
+                tiles.push_back({ static_cast<match_length_t>(p), static_cast<match_length_t>(t), length });
+                length_of_tokens_tiled += length;
+            }
+        }
+        if (length_of_tokens_tiled == prev_length_of_tokens_tiled && ++tiled_count_repeats > 10) {
+            break;
+        }
+
+        if (search_length > 2 * init_search_length) {
+            search_length >>= 1;
+        } else if (search_length > init_search_length) {
+            search_length = init_search_length;
+        } else {
+            --search_length;
+        }
+    }
+    return tiles;
+}
+
+
+static bool tiles_are_equal(const Tiles& a, const Tiles& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Tile& x, const Tile& y) {
+        return std::tie(x.pattern_index, x.text_index, x.match_length) == std::tie(y.pattern_index, y.text_index, y.match_length);
+    });
+}
+
+
 SCENARIO("Proper substrings of simple strings produces always at least one match when the minimum match length is half of the substring.", "[match-simple]") {
-    CAPTURE(data_generator_seed);
+    CAPTURE(data_generator_seed());
 
     constexpr auto pattern_size = 4lu;
     constexpr auto init_search_length = pattern_size >> 1;
@@ -90,7 +184,7 @@ SCENARIO("Proper substrings of simple strings produces always at least one match
 
 
 SCENARIO("Proper substrings of simple strings produces always at least one match when the minimum match length is equal to the substring.", "[match-simple-exact]") {
-    CAPTURE(data_generator_seed);
+    CAPTURE(data_generator_seed());
 
     constexpr auto pattern_size = 4lu;
     const std::string text = "abcdefghijklmnopqrst";
@@ -151,7 +245,7 @@ SCENARIO("Proper substrings of simple strings produces always at least one match
 
 
 SCENARIO("Proper substrings of simple strings never match if all matches contain initial marks", "[nomatch-simple-marked]") {
-    CAPTURE(data_generator_seed);
+    CAPTURE(data_generator_seed());
 
     constexpr auto pattern_size = 4lu;
     const std::string text = "abcdefghijklmnopqrst";
@@ -219,7 +313,7 @@ SCENARIO("Proper substrings of simple strings never match if all matches contain
 
 
 SCENARIO("Two matches of different length but the longer is already marked", "[match-two-marked]") {
-    CAPTURE(data_generator_seed);
+    CAPTURE(data_generator_seed());
 
     constexpr auto init_search_length = 4;
 
@@ -262,7 +356,7 @@ SCENARIO("Two matches of different length but the longer is already marked", "[m
 
 
 SCENARIO("Strings that have no characters in common can never have matches", "[no-match-simple]") {
-    CAPTURE(data_generator_seed);
+    CAPTURE(data_generator_seed());
 
     GIVEN("Two disjoint strings") {
         const std::string text = "abcdefghijklmnopqrst";
@@ -281,7 +375,7 @@ SCENARIO("Strings that have no characters in common can never have matches", "[n
 
 
 SCENARIO("Proper substrings of random strings produces always at least one match when the minimum match length is less than the substring length", "[match-random]") {
-    CAPTURE(data_generator_seed);
+    CAPTURE(data_generator_seed());
 
     GIVEN("One random string of size 10000 and its substring") {
         constexpr auto text_size = 10000lu;
@@ -316,7 +410,7 @@ SCENARIO("Proper substrings of random strings produces always at least one match
 
 
 SCENARIO("Random strings with random marks", "[match-random-and-marks]") {
-    CAPTURE(data_generator_seed);
+    CAPTURE(data_generator_seed());
 
     GIVEN("One random string of size 10000 and its substring") {
         const auto text_size = 10000lu;
@@ -358,3 +452,284 @@ SCENARIO("Random strings with random marks", "[match-random-and-marks]") {
         }
     }
 }
+
+
+SCENARIO("Tiles keep the pattern and text orientation regardless of which string is indexed", "[match-orientation]") {
+    CAPTURE(data_generator_seed());
+
+    constexpr auto init_search_length = 20lu;
+
+    GIVEN("A random string of size 10000 and a random substring of it as the text") {
+        constexpr auto pattern_size = 10000lu;
+        const std::string pattern = next_string(pattern_size);
+        const auto text_size = next_integer(init_search_length, pattern_size / 4);
+        const auto text_begin = next_integer(0lu, pattern_size - text_size);
+        const std::string text = pattern.substr(text_begin, text_size);
+
+        WHEN("Calling match_strings with the longer string as pattern") {
+            const auto& tiles = match_strings(pattern, text, init_search_length);
+
+            THEN("The text is tiled completely by a single tile at its position in the pattern") {
+                REQUIRE(tiles.size() == 1);
+                REQUIRE(tiles[0].pattern_index == text_begin);
+                REQUIRE(tiles[0].text_index == 0);
+                REQUIRE(tiles[0].match_length == text_size);
+            }
+        }
+    }
+
+    GIVEN("Two random copies of a random string of size 10000, with most of the pattern marked") {
+        constexpr auto text_size = 10000lu;
+        const std::string text = next_string(text_size);
+        const std::string pattern = random_string_copy(text, 0.9);
+        const std::string pattern_marks = next_bitstring(pattern.size() - pattern.size() / 2, 0.01) + std::string(pattern.size() / 2, '1');
+
+        WHEN("Calling match_strings with the given parameters") {
+            const auto& tiles = match_strings(pattern, text, init_search_length, pattern_marks);
+
+            THEN("The pattern has fewer than half the unmarked tokens of the text, so the pattern is indexed") {
+                REQUIRE(pattern_marks.size() == pattern.size());
+                REQUIRE(2 * static_cast<std::size_t>(std::count(pattern_marks.begin(), pattern_marks.end(), '0')) < text.size());
+            }
+            THEN("All tiles point to equal, initially unmarked substrings of pattern and text") {
+                REQUIRE(all_matches_are_non_overlapping(tiles));
+                for (auto& tile : tiles) {
+                    REQUIRE(pattern.substr(tile.pattern_index, tile.match_length)
+                            == text.substr(tile.text_index, tile.match_length));
+                    REQUIRE(pattern_marks.find('1', tile.pattern_index) >= tile.pattern_index + tile.match_length);
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Tiles are those of streaming the pattern through an index of the text, regardless of which string is indexed", "[match-baseline]") {
+    CAPTURE(data_generator_seed());
+
+    GIVEN("A pattern with fewer than half the unmarked tokens of the text, whose first long match in the order of the text is not the first in the order of the pattern") {
+        const std::string pattern = "cbaccaa";
+        const std::string text = "acbbabacccaddddd";
+
+        WHEN("Calling match_strings in both orientations with both hashing modes") {
+            THEN("The tiles are equal to the original implementation") {
+                REQUIRE(baseline_tiles(pattern, text, 2).size() == 2);
+                for (const auto& hashing_mode : { HashingMode::rolling, HashingMode::prefix }) {
+                    CAPTURE(static_cast<int>(hashing_mode));
+                    const auto& tiles = match_strings(pattern, text, 2, "", "", hashing_mode);
+                    REQUIRE(tiles_are_equal(tiles, baseline_tiles(pattern, text, 2)));
+                    match_length_t tokens_tiled = 0;
+                    for (const auto& tile : tiles) {
+                        tokens_tiled += tile.match_length;
+                    }
+                    REQUIRE(tokens_tiled == 5);
+                    REQUIRE(tiles_are_equal(match_strings(text, pattern, 2, "", "", hashing_mode), baseline_tiles(text, pattern, 2)));
+                }
+            }
+        }
+    }
+
+    GIVEN("Random strings over small alphabets, their random copies of different lengths, and random marks") {
+        std::vector<std::pair<std::string, std::string> > strings;
+        for (auto i = 0u; i < 20; ++i) {
+            const auto& original = next_zipf_string(next_integer(20, 200), 2 + i % 4, 1.0);
+            strings.emplace_back(original, next_bitstring(original.size(), i % 2 ? 0.0f : 0.05f));
+            const auto& copy = random_string_copy(original, 0.9f).substr(0, next_integer(10, 250));
+            strings.emplace_back(copy, next_bitstring(copy.size(), i % 3 ? 0.0f : 0.05f));
+        }
+
+        WHEN("Calling match_strings on consecutive strings in both orientations with both hashing modes") {
+            THEN("The tiles are equal to the original implementation") {
+                for (auto i = 0u; i + 1 < strings.size(); ++i) {
+                    const auto& a = strings[i];
+                    const auto& b = strings[i + 1];
+                    for (const auto& init_search_length : { 2u, 3u, 5u }) {
+                        for (const auto& hashing_mode : { HashingMode::rolling, HashingMode::prefix }) {
+                            CAPTURE(a.first, a.second, b.first, b.second, init_search_length, static_cast<int>(hashing_mode));
+                            REQUIRE(tiles_are_equal(match_strings(a.first, b.first, init_search_length, a.second, b.second, hashing_mode),
+                                                    baseline_tiles(a.first, b.first, init_search_length, a.second, b.second)));
+                            REQUIRE(tiles_are_equal(match_strings(b.first, a.first, init_search_length, b.second, a.second, hashing_mode),
+                                                    baseline_tiles(b.first, a.first, init_search_length, b.second, a.second)));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Rolling and prefix hashing modes produce the same tiles", "[match-hashing-modes]") {
+    CAPTURE(data_generator_seed());
+
+    constexpr auto init_search_length = 10lu;
+
+    GIVEN("A random string of size 2000 and a random copy of it, with random marks") {
+        constexpr auto text_size = 2000lu;
+        const std::string text = next_string(text_size);
+        const auto copy_prob = 0.9f + next_integer(0, 10) / 100.0f;
+        const std::string pattern = random_string_copy(text, copy_prob);
+        const std::string pattern_marks = next_bitstring(pattern.size(), 0.01);
+        const std::string text_marks = next_bitstring(text.size(), 0.01);
+        CAPTURE(copy_prob);
+
+        WHEN("Calling match_strings with both hashing modes") {
+            const auto& rolling_tiles = match_strings(pattern, text, init_search_length, pattern_marks, text_marks, HashingMode::rolling);
+            const auto& prefix_tiles = match_strings(pattern, text, init_search_length, pattern_marks, text_marks, HashingMode::prefix);
+
+            THEN("The tiles are equal") {
+                REQUIRE(rolling_tiles.size() == prefix_tiles.size());
+                for (auto i = 0u; i < rolling_tiles.size(); ++i) {
+                    REQUIRE(rolling_tiles[i].pattern_index == prefix_tiles[i].pattern_index);
+                    REQUIRE(rolling_tiles[i].text_index == prefix_tiles[i].text_index);
+                    REQUIRE(rolling_tiles[i].match_length == prefix_tiles[i].match_length);
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("Tile streams yield the tiles of match_strings pass by pass, longest first", "[match-tile-stream]") {
+    CAPTURE(data_generator_seed());
+
+    constexpr auto init_search_length = 10lu;
+
+    GIVEN("A random string of size 2000 and a random copy of it, with random marks") {
+        constexpr auto text_size = 2000lu;
+        const std::string text = next_string(text_size);
+        const auto copy_prob = 0.8f + next_integer(0, 20) / 100.0f;
+        const std::string pattern = random_string_copy(text, copy_prob);
+        const std::string pattern_marks = next_bitstring(pattern.size(), 0.01);
+        const std::string text_marks = next_bitstring(text.size(), 0.01);
+        CAPTURE(copy_prob);
+
+        WHEN("Reading tile streams with both hashing modes until they are finished") {
+            for (const auto& hashing_mode : { HashingMode::rolling, HashingMode::prefix }) {
+                const auto& tiles = match_strings(pattern, text, init_search_length, pattern_marks, text_marks, hashing_mode);
+                TileStream stream(pattern, text, init_search_length, pattern_marks, text_marks, hashing_mode);
+                Tiles streamed_tiles;
+                Tiles pass_tiles;
+                while (stream.next(pass_tiles)) {
+                    // Every pass is non-empty and ordered longest first
+                    REQUIRE_FALSE(pass_tiles.empty());
+                    for (auto i = 1u; i < pass_tiles.size(); ++i) {
+                        REQUIRE(pass_tiles[i - 1].match_length >= pass_tiles[i].match_length);
+                    }
+                    for (const auto& tile : pass_tiles) {
+                        streamed_tiles.push_back(tile);
+                    }
+                    pass_tiles.clear();
+                }
+                REQUIRE(stream.finished());
+
+                // The streamed tiles are the tiles of match_strings
+                REQUIRE(streamed_tiles.size() == tiles.size());
+                std::vector<std::tuple<match_length_t, match_length_t, match_length_t> > expected, streamed;
+                for (auto i = 0u; i < tiles.size(); ++i) {
+                    expected.emplace_back(tiles[i].pattern_index, tiles[i].text_index, tiles[i].match_length);
+                    streamed.emplace_back(streamed_tiles[i].pattern_index, streamed_tiles[i].text_index, streamed_tiles[i].match_length);
+                }
+                std::sort(expected.begin(), expected.end());
+                std::sort(streamed.begin(), streamed.end());
+                REQUIRE(expected == streamed);
+            }
+        }
+    }
+
+    GIVEN("A text shorter than the initial search length") {
+        TileStream stream("abc", "abc", init_search_length);
+
+        THEN("The stream is finished without tiles") {
+            Tiles tiles;
+            REQUIRE(stream.finished());
+            REQUIRE_FALSE(stream.next(tiles));
+            REQUIRE(tiles.empty());
+        }
+    }
+}
+
+
+SCENARIO("Prepared strings produce the tiles of match_strings", "[match-prepared]") {
+    CAPTURE(data_generator_seed());
+
+    constexpr auto init_search_length = 10lu;
+
+    GIVEN("A random string of size 2000 and a random copy of it, with random marks") {
+        constexpr auto text_size = 2000lu;
+        const std::string text = next_string(text_size);
+        const std::string pattern = random_string_copy(text, 0.9f);
+        const std::string pattern_marks = next_bitstring(pattern.size(), 0.01);
+        const std::string text_marks = next_bitstring(text.size(), 0.01);
+
+        WHEN("Both strings are prepared once and matched repeatedly with both hashing modes") {
+            for (const auto& hashing_mode : { HashingMode::rolling, HashingMode::prefix }) {
+                const PreparedString prepared_pattern(pattern, pattern_marks, hashing_mode);
+                const PreparedString prepared_text(text, text_marks, hashing_mode);
+                REQUIRE(prepared_pattern.size() == pattern.size());
+                REQUIRE(prepared_text.footprint() >= text.size());
+                const auto& expected = match_strings(pattern, text, init_search_length, pattern_marks, text_marks, hashing_mode);
+                for (auto repeat = 0; repeat < 2; ++repeat) {
+                    const auto& tiles = match_prepared(prepared_pattern, prepared_text, init_search_length);
+                    REQUIRE(tiles.size() == expected.size());
+                    for (auto i = 0u; i < tiles.size(); ++i) {
+                        REQUIRE(tiles[i].pattern_index == expected[i].pattern_index);
+                        REQUIRE(tiles[i].text_index == expected[i].text_index);
+                        REQUIRE(tiles[i].match_length == expected[i].match_length);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+SCENARIO("One-to-many matching gives the tiles of matching each text alone", "[match-one-to-many]") {
+    CAPTURE(data_generator_seed());
+
+    constexpr auto init_search_length = 5lu;
+
+    GIVEN("A random query and texts that are random copies and exact copies of it, of different lengths and with random marks") {
+        const std::string query = next_string(500);
+        const std::string query_marks = next_bitstring(query.size(), 0.01);
+        std::vector<std::pair<std::string, std::string> > texts;
+        for (auto i = 0u; i < 30; ++i) {
+            const auto& copy_prob = 0.5f + (i % 6) / 10.0f;
+            const auto& text = random_string_copy(query, copy_prob).substr(0, 100 + next_integer(0, 800));
+            texts.emplace_back(text, next_bitstring(text.size(), i % 3 == 0 ? 0.0f : 0.02f));
+        }
+        texts.emplace_back(query, "");
+        texts.emplace_back(query + query, "");
+        texts.emplace_back("abc", "");
+        texts.emplace_back(next_string(1000), "");
+
+        WHEN("Matching the query against all texts at once, with the query or the shorter string as the pattern") {
+            THEN("The tiles of every text are equal to match_strings") {
+                for (const auto& shorter_as_pattern : { false, true }) {
+                    const auto& all_tiles = match_one_to_many(query, texts, init_search_length, query_marks, shorter_as_pattern);
+                    REQUIRE(all_tiles.size() == texts.size());
+                    for (auto i = 0u; i < texts.size(); ++i) {
+                        const auto& text = texts[i];
+                        const bool text_is_pattern = shorter_as_pattern and text.first.size() < query.size();
+                        const auto& expected = text_is_pattern
+                            ? match_strings(text.first, query, init_search_length, text.second, query_marks)
+                            : match_strings(query, text.first, init_search_length, query_marks, text.second);
+                        CAPTURE(i, shorter_as_pattern);
+                        REQUIRE(all_tiles[i].size() == expected.size());
+                        for (auto j = 0u; j < expected.size(); ++j) {
+                            REQUIRE(all_tiles[i][j].pattern_index == (text_is_pattern ? expected[j].text_index : expected[j].pattern_index));
+                            REQUIRE(all_tiles[i][j].text_index == (text_is_pattern ? expected[j].pattern_index : expected[j].text_index));
+                            REQUIRE(all_tiles[i][j].match_length == expected[j].match_length);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    GIVEN("No texts") {
+        THEN("There are no tiles") {
+            REQUIRE(match_one_to_many("abcdef", {}, 3).empty());
+        }
+    }
+}
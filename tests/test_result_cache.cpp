@@ -0,0 +1,175 @@
+#include "result_cache.hpp"
+#include "data_generator.hpp"
+#include "catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+
+static std::string to_hex(const Digest& digest) {
+    std::ostringstream hex;
+    for (const auto& byte : digest) {
+        hex << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned>(byte);
+    }
+    return hex.str();
+}
+
+
+// Path of a new file that does not exist
+static std::string temporary_cache_path() {
+    char path[] = "/tmp/gst_result_cache_XXXXXX";
+    const auto fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+    std::remove(path);
+    return path;
+}
+
+
+static void require_equal_tiles(const Tiles& tiles_a, const Tiles& tiles_b) {
+    REQUIRE(tiles_a.size() == tiles_b.size());
+    for (auto i = 0u; i < tiles_a.size(); ++i) {
+        REQUIRE(tiles_a[i].pattern_index == tiles_b[i].pattern_index);
+        REQUIRE(tiles_a[i].text_index == tiles_b[i].text_index);
+        REQUIRE(tiles_a[i].match_length == tiles_b[i].match_length);
+    }
+}
+
+
+SCENARIO("SHA-256 digests match the FIPS 180-4 examples", "[sha256]") {
+
+    GIVEN("The example messages") {
+        THEN("Their digests are the published ones") {
+            Sha256 empty;
+            REQUIRE(to_hex(empty.digest()) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+            Sha256 abc;
+            abc.update("abc");
+            REQUIRE(to_hex(abc.digest()) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+            Sha256 two_blocks;
+            two_blocks.update("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+            REQUIRE(to_hex(two_blocks.digest()) == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        }
+
+        THEN("Updating in pieces gives the digest of the whole message") {
+            const std::string message(1000, 'a');
+            Sha256 whole;
+            whole.update(message);
+            Sha256 pieces;
+            for (auto i = 0u; i < message.size(); i += 7) {
+                pieces.update(message.substr(i, 7));
+            }
+            REQUIRE(whole.digest() == pieces.digest());
+        }
+    }
+}
+
+
+SCENARIO("Result cache keys depend on all arguments of match_strings", "[result-cache-key]") {
+
+    GIVEN("A pattern and a text") {
+        const std::string pattern = "abcdefgh";
+        const std::string text = "xxabcdefghxx";
+        const auto& key = result_cache_key(pattern, text, 3);
+
+        THEN("Missing marks and unmarked tokens give the same key") {
+            REQUIRE(result_cache_key(pattern, text, 3, "00000000", "000000000000") == key);
+            REQUIRE(result_cache_key(pattern, text, 3, "0", "") == key);
+        }
+
+        THEN("Changing any argument changes the key") {
+            REQUIRE(result_cache_key(pattern, text, 4) != key);
+            REQUIRE(result_cache_key(text, pattern, 3) != key);
+            REQUIRE(result_cache_key(pattern + "x", text, 3) != key);
+            REQUIRE(result_cache_key(pattern, text, 3, "1") != key);
+            REQUIRE(result_cache_key(pattern, text, 3, "", "01") != key);
+            REQUIRE(result_cache_key("abcdefghx", "xabcdefghxx", 3) != key);
+        }
+    }
+}
+
+
+SCENARIO("Result caches persist match_strings results", "[result-cache]") {
+
+    GIVEN("A new cache file and random strings") {
+        const auto& path = temporary_cache_path();
+        const auto& pattern = next_string(1000);
+        const auto& text = random_string_copy(pattern, 0.5);
+        const auto& expected = match_strings(pattern, text, 5);
+
+        WHEN("A result is matched through the cache") {
+            {
+                ResultCache cache(path);
+                REQUIRE(cache.size() == 0);
+                require_equal_tiles(cache.match(pattern, text, 5), expected);
+                REQUIRE(cache.size() == 1);
+                require_equal_tiles(cache.match(pattern, text, 5), expected);
+                REQUIRE(cache.size() == 1);
+            }
+
+            THEN("It is found after reopening the file") {
+                ResultCache cache(path);
+                Tiles tiles;
+                REQUIRE(cache.find(result_cache_key(pattern, text, 5), tiles));
+                require_equal_tiles(tiles, expected);
+                REQUIRE_FALSE(cache.find(result_cache_key(pattern, text, 6), tiles));
+            }
+        }
+
+        WHEN("Two caches share the file") {
+            ResultCache cache_a(path);
+            ResultCache cache_b(path);
+            REQUIRE(cache_a.insert(result_cache_key(pattern, text, 5), expected));
+            REQUIRE(cache_b.insert(result_cache_key(text, pattern, 5), match_strings(text, pattern, 5)));
+
+            THEN("Each finds the results stored by the other") {
+                Tiles tiles_a, tiles_b;
+                REQUIRE(cache_a.find(result_cache_key(text, pattern, 5), tiles_a));
+                REQUIRE(cache_b.find(result_cache_key(pattern, text, 5), tiles_b));
+                require_equal_tiles(tiles_a, match_strings(text, pattern, 5));
+                require_equal_tiles(tiles_b, expected);
+                REQUIRE(cache_a.size() == 2);
+                REQUIRE(cache_b.size() == 2);
+            }
+        }
+
+        WHEN("A partially written record is left at the end of the file") {
+            {
+                ResultCache cache(path);
+                REQUIRE(cache.insert(result_cache_key(pattern, text, 5), expected));
+            }
+            {
+                std::ofstream file(path, std::ios::binary | std::ios::app);
+                file << "GSTR\x10";
+            }
+
+            THEN("It is ignored and overwritten by the next record") {
+                ResultCache cache(path);
+                REQUIRE(cache.size() == 1);
+                REQUIRE(cache.insert(result_cache_key(pattern, text, 6), match_strings(pattern, text, 6)));
+                ResultCache reopened(path);
+                REQUIRE(reopened.size() == 2);
+                Tiles tiles;
+                REQUIRE(reopened.find(result_cache_key(pattern, text, 6), tiles));
+                require_equal_tiles(tiles, match_strings(pattern, text, 6));
+            }
+        }
+
+        std::remove(path.c_str());
+    }
+
+    GIVEN("A file that is not a cache") {
+        const auto& path = temporary_cache_path();
+        {
+            std::ofstream file(path);
+            file << "not a cache";
+        }
+
+        THEN("It cannot be opened as a cache") {
+            REQUIRE_THROWS_AS(ResultCache(path), std::invalid_argument);
+        }
+
+        std::remove(path.c_str());
+    }
+}
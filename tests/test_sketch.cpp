@@ -0,0 +1,133 @@
+#include "sketch.hpp"
+#include "data_generator.hpp"
+#include "catch.hpp"
+
+
+SCENARIO("MinHash signatures of identical strings are identical", "[sketch-identical]") {
+    CAPTURE(data_generator_seed());
+
+    constexpr auto kgram_length = 8lu;
+    constexpr auto num_hashes = 64lu;
+
+    GIVEN("One random string of size 1000") {
+        const std::string text = next_string(1000lu);
+
+        WHEN("Computing two signatures of the same string") {
+            const auto& a = minhash_signature(text, "", kgram_length, num_hashes);
+            const auto& b = minhash_signature(text, "", kgram_length, num_hashes);
+
+            THEN("The signatures are equal and the estimated similarity is 1") {
+                REQUIRE(a.size() == num_hashes);
+                REQUIRE(a == b);
+                REQUIRE(estimate_jaccard(a, b) == 1.0);
+            }
+        }
+    }
+
+    GIVEN("A string that is too short to contain a k-gram") {
+        const std::string text = next_string(kgram_length - 1);
+
+        WHEN("Computing its signature") {
+            const auto& signature = minhash_signature(text, "", kgram_length, num_hashes);
+
+            THEN("The signature is empty and not similar to itself") {
+                REQUIRE(signature.empty());
+                REQUIRE(estimate_jaccard(signature, signature) == 0.0);
+            }
+        }
+    }
+}
+
+
+SCENARIO("MinHash signatures ignore marked k-grams", "[sketch-marks]") {
+    CAPTURE(data_generator_seed());
+
+    constexpr auto kgram_length = 4lu;
+    constexpr auto num_hashes = 64lu;
+
+    GIVEN("Two strings that differ only in a marked region") {
+        const std::string text_a = "abcdefghijklmnopqrst";
+        const std::string text_b = "abcdefghijXXXXXXXXXX";
+        const std::string marks = "00000000001111111111";
+
+        WHEN("Computing signatures with the marks") {
+            const auto& a = minhash_signature(text_a, marks, kgram_length, num_hashes);
+            const auto& b = minhash_signature(text_b, marks, kgram_length, num_hashes);
+
+            THEN("The signatures are equal") {
+                REQUIRE(a == b);
+            }
+        }
+
+        WHEN("Computing signatures without the marks") {
+            const auto& a = minhash_signature(text_a, "", kgram_length, num_hashes);
+            const auto& b = minhash_signature(text_b, "", kgram_length, num_hashes);
+
+            THEN("The signatures differ") {
+                REQUIRE(a != b);
+            }
+        }
+    }
+
+    GIVEN("A string with every k-gram marked") {
+        const std::string text = "abcdefghijklmnopqrst";
+        const std::string marks = "00010001000100010001";
+
+        WHEN("Computing its signature") {
+            const auto& signature = minhash_signature(text, marks, kgram_length, num_hashes);
+
+            THEN("The signature is empty") {
+                REQUIRE(signature.empty());
+            }
+        }
+    }
+}
+
+
+SCENARIO("LSH index finds near-duplicate pairs among random strings", "[sketch-lsh]") {
+    CAPTURE(data_generator_seed());
+
+    constexpr auto kgram_length = 5lu;
+    constexpr auto bands = 32lu;
+    constexpr auto rows = 4lu;
+
+    GIVEN("Ten unrelated random strings and one near copy of the first") {
+        std::vector<std::pair<std::string, std::string> > documents;
+        for (auto i = 0; i < 10; ++i) {
+            documents.emplace_back(next_string(2000lu), "");
+        }
+        documents.emplace_back(random_string_copy(documents[0].first, 0.99), "");
+
+        WHEN("Querying candidate pairs") {
+            const auto& candidates = sketch_candidates(documents, kgram_length, 0.5, bands, rows);
+
+            THEN("The only candidate is the near copy") {
+                REQUIRE(candidates.size() == 1);
+                REQUIRE(candidates[0].a == 0);
+                REQUIRE(candidates[0].b == documents.size() - 1);
+                REQUIRE(candidates[0].similarity >= 0.5);
+            }
+        }
+    }
+
+    GIVEN("A cluster of identical strings, which collide in every band") {
+        const auto& text = next_string(500lu);
+        const std::vector<std::pair<std::string, std::string> > documents(6, { text, "" });
+
+        WHEN("Querying candidate pairs") {
+            const auto& candidates = sketch_candidates(documents, kgram_length, 0.5, bands, rows);
+
+            THEN("Every pair of the cluster is a candidate exactly once, in index order") {
+                REQUIRE(candidates.size() == documents.size() * (documents.size() - 1) / 2);
+                auto candidate = candidates.begin();
+                for (auto a = 0u; a < documents.size(); ++a) {
+                    for (auto b = a + 1; b < documents.size(); ++b, ++candidate) {
+                        REQUIRE(candidate->a == a);
+                        REQUIRE(candidate->b == b);
+                        REQUIRE(candidate->similarity == 1.0);
+                    }
+                }
+            }
+        }
+    }
+}
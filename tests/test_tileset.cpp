@@ -0,0 +1,75 @@
+#include "tileset.hpp"
+#include "data_generator.hpp"
+#include "catch.hpp"
+
+
+SCENARIO("Tiles that overlap in pattern or text are not added", "[tileset-overlap]") {
+
+    GIVEN("A set with the tile (10, 20, 5)") {
+        TileSet tileset;
+        REQUIRE(tileset.add_non_overlapping({ 10, 20, 5 }));
+
+        THEN("Tiles overlapping in pattern or text are rejected") {
+            REQUIRE_FALSE(tileset.add_non_overlapping({ 14, 0, 5 }));
+            REQUIRE_FALSE(tileset.add_non_overlapping({ 6, 0, 5 }));
+            REQUIRE_FALSE(tileset.add_non_overlapping({ 0, 24, 1 }));
+            REQUIRE_FALSE(tileset.add_non_overlapping({ 0, 0, 100 }));
+            REQUIRE(tileset.size() == 1);
+        }
+
+        THEN("Adjacent tiles are accepted and counted") {
+            REQUIRE(tileset.add_non_overlapping({ 15, 25, 5 }));
+            REQUIRE(tileset.add_non_overlapping({ 5, 15, 5 }));
+            REQUIRE(tileset.size() == 3);
+            REQUIRE(tileset.token_count() == 15);
+        }
+    }
+}
+
+
+SCENARIO("Tile sets are iterated, reversed and serialized in pattern index order", "[tileset-order]") {
+    CAPTURE(data_generator_seed());
+
+    GIVEN("A set with random non-overlapping tiles") {
+        TileSet tileset;
+        for (auto i = 0; i < 1000; ++i) {
+            tileset.add_non_overlapping({ next_integer(0lu, 100000lu), next_integer(0lu, 100000lu), next_integer(1lu, 50lu) });
+        }
+
+        THEN("Iteration is ordered by pattern index") {
+            match_length_t prev = 0;
+            for (const auto& entry : tileset) {
+                REQUIRE(prev <= entry.second.pattern_index);
+                prev = entry.second.pattern_index;
+            }
+        }
+
+        THEN("Reversing twice produces the same tiles") {
+            const auto& reversed = tileset.reversed();
+            REQUIRE(reversed.token_count() == tileset.token_count());
+            REQUIRE(reversed.reversed().json() == tileset.json());
+        }
+
+        THEN("Binary serialization round trips") {
+            TileSet copy;
+            REQUIRE(TileSet::from_bytes(tileset.to_bytes(), copy));
+            REQUIRE(copy.json() == tileset.json());
+            REQUIRE(copy.token_count() == tileset.token_count());
+        }
+
+        THEN("Truncated bytes are rejected") {
+            TileSet copy;
+            const auto& bytes = tileset.to_bytes();
+            REQUIRE_FALSE(TileSet::from_bytes(bytes.substr(0, bytes.size() - 1), copy));
+            REQUIRE(copy.size() == 0);
+        }
+    }
+
+    GIVEN("A full match") {
+        const auto& tileset = TileSet::full_match(42);
+
+        THEN("Its JSON is compact") {
+            REQUIRE(tileset.json() == "[[0,0,42]]");
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#include "window_fingerprints.hpp"
+#include "data_generator.hpp"
+#include "catch.hpp"
+
+
+SCENARIO("Window fingerprints contain one hash for each window", "[window-fingerprints]") {
+    GIVEN("A string with repeated substrings") {
+        const std::string text = "abcabcabcx";
+
+        WHEN("Computing its fingerprints for windows of length 3") {
+            const auto& fingerprints = window_fingerprints(text, 3);
+
+            THEN("Equal windows have equal fingerprints") {
+                REQUIRE(fingerprints.size() == text.size() - 2);
+                REQUIRE(fingerprints[0] == fingerprints[3]);
+                REQUIRE(fingerprints[0] == fingerprints[6]);
+                REQUIRE(fingerprints[1] == fingerprints[4]);
+                REQUIRE(fingerprints[0] != fingerprints[7]);
+            }
+        }
+
+        WHEN("Computing its fingerprints for windows longer than the string or of length 0") {
+            THEN("There are no fingerprints") {
+                REQUIRE(window_fingerprints(text, text.size() + 1).empty());
+                REQUIRE(window_fingerprints(text, 0).empty());
+            }
+        }
+    }
+}
+
+
+SCENARIO("Batch window fingerprints are equal to the fingerprints of each document", "[window-fingerprints-batch]") {
+    CAPTURE(data_generator_seed());
+
+    GIVEN("More documents than fingerprint lanes, of different lengths, including empty documents and all byte values") {
+        std::vector<std::pair<std::string, std::string> > documents;
+        for (auto i = 0u; i < 4 * fingerprint_lanes + 3; ++i) {
+            documents.emplace_back(next_string((i * 37) % 300), "");
+        }
+        documents.emplace_back("", "");
+        std::string all_bytes;
+        for (auto chr = 0u; chr < 256; ++chr) {
+            all_bytes.push_back(static_cast<char>(chr));
+        }
+        documents.emplace_back(all_bytes + all_bytes, "");
+
+        WHEN("Computing the fingerprints of all documents in one batch") {
+            THEN("The fingerprints of every document are equal to computing them separately, for every window length") {
+                for (const auto& window_length : { 0lu, 1lu, 2lu, 20lu, 31lu, 32lu, 33lu, 64lu, 65lu, 299lu }) {
+                    CAPTURE(window_length);
+                    const auto& batch = batch_window_fingerprints(documents, window_length);
+                    REQUIRE(batch.size() == documents.size());
+                    REQUIRE(batch_window_fingerprints(documents, window_length, FingerprintLanes::scalar) == batch);
+                    for (auto i = 0u; i < documents.size(); ++i) {
+                        CAPTURE(i);
+                        REQUIRE(batch[i] == window_fingerprints(documents[i].first, window_length));
+                    }
+                }
+            }
+        }
+    }
+
+    GIVEN("Amounts of documents that are not multiples of the fingerprint lanes, some shorter than the window") {
+        constexpr auto window_length = 20lu;
+        std::vector<std::vector<std::pair<std::string, std::string> > > batches;
+        for (const auto& document_count : { 1lu, fingerprint_lanes - 1, fingerprint_lanes + 1, 2 * fingerprint_lanes + 5 }) {
+            std::vector<std::pair<std::string, std::string> > documents;
+            for (auto i = 0u; i < document_count; ++i) {
+                documents.emplace_back(next_string(i % 3 == 0 ? next_integer(0lu, window_length) : next_integer(window_length, 200lu)), "");
+            }
+            batches.push_back(documents);
+        }
+
+        WHEN("Computing their fingerprints with the automatically chosen and the scalar lanes") {
+            THEN("Both give the fingerprints of each document") {
+                for (const auto& documents : batches) {
+                    CAPTURE(documents.size());
+                    const auto& automatic = batch_window_fingerprints(documents, window_length);
+                    const auto& scalar = batch_window_fingerprints(documents, window_length, FingerprintLanes::scalar);
+                    REQUIRE(automatic.size() == documents.size());
+                    REQUIRE(scalar.size() == documents.size());
+                    for (auto i = 0u; i < documents.size(); ++i) {
+                        CAPTURE(i);
+                        REQUIRE(scalar[i] == automatic[i]);
+                        REQUIRE(scalar[i] == window_fingerprints(documents[i].first, window_length));
+                    }
+                }
+            }
+        }
+    }
+
+    GIVEN("No documents") {
+        const std::vector<std::pair<std::string, std::string> > documents;
+
+        WHEN("Computing their fingerprints") {
+            THEN("There are none") {
+                REQUIRE(batch_window_fingerprints(documents, 20).empty());
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#include "worker_pool.hpp"
+#include "catch.hpp"
+#include <atomic>
+
+
+SCENARIO("Worker pools run or drop all submitted tasks", "[worker-pool]") {
+
+    GIVEN("A pool with 4 workers and 1000 submitted tasks") {
+        WorkerPool pool(4);
+        std::atomic<int> run_count(0);
+        std::atomic<int> dropped_count(0);
+        for (auto i = 0; i < 1000; ++i) {
+            REQUIRE(pool.submit([&](bool dropped) { ++(dropped ? dropped_count : run_count); }));
+        }
+        REQUIRE(pool.size() == 4);
+
+        WHEN("The pool is shut down after running pending tasks") {
+            const auto& dropped_tasks = pool.shutdown(true);
+
+            THEN("All tasks were run and no tasks are accepted") {
+                REQUIRE(run_count == 1000);
+                REQUIRE(dropped_tasks.empty());
+                REQUIRE_FALSE(pool.submit([](bool) {}));
+            }
+        }
+
+        WHEN("The pool is shut down without running pending tasks") {
+            for (auto& task : pool.shutdown(false)) {
+                task(true);
+            }
+
+            THEN("Every task was either run or returned exactly once") {
+                REQUIRE(run_count + dropped_count == 1000);
+                REQUIRE_FALSE(pool.submit([](bool) {}));
+            }
+        }
+    }
+
+    GIVEN("A pool with no workers requested") {
+        WorkerPool pool(0);
+
+        THEN("It has one worker") {
+            REQUIRE(pool.size() == 1);
+        }
+    }
+}